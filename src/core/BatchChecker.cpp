@@ -0,0 +1,150 @@
+#include "./BatchChecker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+
+#include "hack/DiagnosticsEngine.hpp"
+#include "hack/HackAssembler.hpp"
+#include "lib/MappedFile.hpp"
+#include "lib/uri.hpp"
+#include "lsp/protocol.hpp"
+#include <nlohmann/json.hpp>
+
+int BatchChecker::run(std::ostream &out) {
+  std::vector<FileReport> failures;
+  auto files = collectFiles(failures);
+
+  std::vector<FileReport> reports(files.size());
+  for (size_t i = 0; i < files.size(); i++)
+    reports[i].path = files[i];
+
+  // Largest files first, handed out through a shared counter like the
+  // WorkspaceIndexer does, so the slowest file starts early and no worker
+  // idles while another still has a queue
+  std::vector<size_t> order(files.size());
+  std::vector<uintmax_t> sizes(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    std::error_code ec;
+    order[i] = i;
+    sizes[i] = std::filesystem::file_size(files[i], ec);
+  }
+  std::sort(order.begin(), order.end(),
+            [&](size_t lhs, size_t rhs) { return sizes[lhs] > sizes[rhs]; });
+
+  size_t threadCount = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()), files.size());
+
+  std::atomic<size_t> next = 0;
+  std::vector<std::thread> workers;
+  workers.reserve(threadCount);
+
+  for (size_t t = 0; t < threadCount; t++) {
+    workers.emplace_back([&] {
+      for (size_t i = next++; i < order.size(); i = next++) {
+        check(reports[order[i]]);
+      }
+    });
+  }
+
+  for (auto &thread : workers) {
+    thread.join();
+  }
+
+  size_t errorCount = 0;
+  auto results = nlohmann::ordered_json::array();
+  auto failed = nlohmann::ordered_json::array();
+
+  for (auto &report : reports) {
+    if (!report.failure.empty()) {
+      failures.push_back(std::move(report));
+      continue;
+    }
+    if (report.diagnostics.empty())
+      continue;
+
+    errorCount += report.diagnostics.size();
+
+    nlohmann::ordered_json result;
+    result["path"] = report.path.string();
+    result["uri"] =
+        uri::fromPath(std::filesystem::absolute(report.path).string());
+    result["diagnostics"] = DiagnosticsEngine::toJson(report.diagnostics);
+    results.push_back(std::move(result));
+  }
+
+  for (const auto &failure : failures) {
+    nlohmann::ordered_json entry;
+    entry["path"] = failure.path.string();
+    entry["message"] = failure.failure;
+    failed.push_back(std::move(entry));
+  }
+
+  nlohmann::ordered_json summary;
+  summary["version"] = protocol::serverDetails::SERVER_VERSION;
+  summary["files"] = files.size();
+  summary["errors"] = errorCount;
+  summary["results"] = std::move(results);
+  summary["failures"] = std::move(failed);
+  out << summary.dump(2) << std::endl;
+
+  if (!failures.empty())
+    return FAILED;
+  return errorCount > 0 ? HAS_ERRORS : CLEAN;
+}
+
+std::vector<std::filesystem::path>
+BatchChecker::collectFiles(std::vector<FileReport> &missing) {
+  std::vector<std::filesystem::path> files;
+
+  for (const auto &argument : paths) {
+    std::filesystem::path root(argument);
+    std::error_code ec;
+
+    if (std::filesystem::is_regular_file(root, ec)) {
+      files.push_back(root);
+      continue;
+    }
+
+    if (!std::filesystem::is_directory(root, ec)) {
+      missing.push_back({root, {}, "No such file or directory"});
+      continue;
+    }
+
+    auto it = std::filesystem::recursive_directory_iterator(
+        root, std::filesystem::directory_options::skip_permission_denied, ec);
+
+    for (; !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      const auto &path = it->path();
+
+      // Skip hidden directories such as .git
+      if (it->is_directory(ec) && path.filename().string().starts_with(".")) {
+        it.disable_recursion_pending();
+        continue;
+      }
+
+      if (path.extension() == ".asm" && it->is_regular_file(ec))
+        files.push_back(path);
+    }
+  }
+
+  // Reports come out in a stable order whatever the directory order is
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+  return files;
+}
+
+void BatchChecker::check(FileReport &report) {
+  MappedFile file(report.path.string());
+  if (!file.isOpen()) {
+    report.failure = "Cannot read file";
+    return;
+  }
+
+  std::string_view text = file.view();
+  // Files are already checked in parallel
+  auto result = HackAssembler::assembleText(std::string(text), 0, false);
+  report.diagnostics = DiagnosticsEngine::buildDiagnostics(text, result);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lsp/messages.hpp"
+
+// hack-ls --check: assembles every .asm file under the given paths on all
+// cores and writes one JSON report with the diagnostics the server would
+// publish for them. Meant for CI, so the exit code says whether anything
+// was found.
+class BatchChecker {
+public:
+  // Exit codes of run()
+  static constexpr int CLEAN = 0;
+  static constexpr int HAS_ERRORS = 1;
+  static constexpr int FAILED = 2; // a path could not be read
+
+  explicit BatchChecker(std::vector<std::string> _paths)
+      : paths(std::move(_paths)) {}
+
+  int run(std::ostream &out);
+
+private:
+  struct FileReport {
+    std::filesystem::path path;
+    std::vector<lsp::DiagnosticMessage> diagnostics;
+    std::string failure; // non-empty if the file could not be read
+  };
+
+  std::vector<std::string> paths;
+
+  // Files named on the command line are taken as is; directories are
+  // searched for .asm files, skipping hidden ones
+  std::vector<std::filesystem::path>
+  collectFiles(std::vector<FileReport> &missing);
+
+  static void check(FileReport &report);
+};
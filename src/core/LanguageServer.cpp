@@ -1,42 +1,100 @@
 #include "./LanguageServer.hpp"
+#include "lib/SpscRing.hpp"
 #include "lsp/errors.hpp"
 #include "lsp/messages.hpp"
 #include <iostream>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <thread>
 
 using nlohmann::json;
 
 void LanguageServer::start() {
+  // The queues are shared with the stages, as the reader may outlive this
+  // call (see below)
+  auto bodies = std::make_shared<SpscRing<std::string, QUEUE_CAPACITY>>();
+  auto parsed = std::make_shared<SpscRing<ParsedMessage, QUEUE_CAPACITY>>();
+
+  // Stage 1: frames bodies off stdin. When the session ends it may be
+  // blocked in a read that nothing can interrupt, so it is detached; its
+  // next push fails and it returns. It shares only the queue and stdin.
+  std::thread([bodies] {
+    while (auto body = MessageIO::readMessage()) { // one full LSP message
+      if (!bodies->push(std::move(*body)))
+        return;
+    }
+
+    bodies->close();
+  }).detach();
+
+  // Stage 2: parses JSON while earlier messages are being handled
+  std::thread parser([bodies, parsed] {
+    while (auto body = bodies->pop()) {
+      if (!parsed->push(parse(*body)))
+        break;
+    }
+    parsed->close();
+  });
+
+  // Stage 3: queues whatever has arrived, then runs the most urgent task on
+  // this thread; waits for input only once nothing is left to do
   while (running) {
+    while (auto message = parsed->tryPop()) {
+      receive(*message);
+    }
 
-    auto body = io.readMessage(); // read one full LSP message
+    if (messagesHandler.runNext())
+      continue;
 
-    if (!body) {
+    auto message = parsed->pop();
+    if (!message) {
       // This means EOF or invalid message
       std::cerr << "Failed to read message or connection closed.\n";
       break;
     }
+    receive(*message);
+  }
 
-    if (body->empty()) {
-      // No content? Likely a notification with no body OR just keep-alive
-      continue;
-    }
+  parsed->close();
+  bodies->close();
+  parser.join();
+}
 
-    json message;
-    try {
-      message = json::parse(body.value());
+bool LanguageServer::handleMessage(const std::string &body) {
+  ParsedMessage parsed = parse(body);
+  receive(parsed);
 
-    } catch (const std::exception &e) {
-      messagesHandler.logError(MessageType::Error, lsp::ErrorCode::PARSE_ERROR,
-                               e.what());
-      continue;
-    }
+  while (messagesHandler.hasMessages() && !shouldExit()) {
+    messagesHandler.runNext();
+  }
+
+  // Check if we should exit after processing the message
+  return !shouldExit();
+}
 
-    messagesHandler.process(message);
+LanguageServer::ParsedMessage LanguageServer::parse(const std::string &body) {
+  ParsedMessage parsed;
 
-    // Check if we should exit after processing the message
-    if (shouldExit()) {
-      break;
-    }
+  // No content? Likely a notification with no body OR just keep-alive
+  if (body.empty())
+    return parsed;
+
+  try {
+    parsed.message = json::parse(body);
+
+  } catch (const std::exception &e) {
+    parsed.error = e.what();
+  }
+  return parsed;
+}
+
+void LanguageServer::receive(ParsedMessage &parsed) {
+  if (!parsed.error.empty()) {
+    messagesHandler.logError(MessageType::Error, lsp::ErrorCode::PARSE_ERROR,
+                             parsed.error.c_str());
+    return;
   }
+
+  if (parsed.message)
+    messagesHandler.receive(std::move(*parsed.message));
 }
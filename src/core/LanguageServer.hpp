@@ -1,16 +1,36 @@
 #pragma once
 
+#include <optional>
+#include <string>
+
 #include "core/handlers/MessagesHandler.hpp"
+#include "core/interfaces/IMessage.hpp"
 #include "core/interfaces/IServerState.hpp"
 #include "core/transport/MessageIO.hpp"
+#include "hack/SharedState.hpp"
+#include <nlohmann/json.hpp>
 
+// One LSP session. Messages arrive through handleMessage(), so the same
+// session logic runs over stdio (start()) and over sockets (SocketServer).
 class LanguageServer : public IServerState {
 
 public:
-  LanguageServer() : messagesHandler(*this, io), running(true) {};
+  LanguageServer(IMessage &io, SharedState &sharedState)
+      : messagesHandler(*this, io, sharedState), running(true) {};
 
+  // Reads messages from stdin until exit or end of input. Framing, parsing
+  // and handling run as three threads connected by SPSC queues, so a large
+  // message is read and parsed while the ones before it are handled.
   void start();
 
+  // Handles one message body; returns false once the session should end.
+  // Background work it queues is left for runPending().
+  bool handleMessage(const std::string &body);
+
+  bool hasPendingWork() const { return messagesHandler.hasWork(); }
+  // Runs one queued task, for event loops that step sessions when idle
+  void runPending() { messagesHandler.runNext(); }
+
   bool isInitialized() override { return initialized; }
   void onInitialize() override { initialized = true; }
   void onShutdown() override { shutdownRequested = true; }
@@ -21,7 +41,20 @@ public:
   bool isNotficationsAllowed() const override { return notificationAllowed; }
 
 private:
-  MessageIO io;
+  // A body after the parser stage: its JSON, or why it did not parse.
+  // Neither is set for an empty body.
+  struct ParsedMessage {
+    std::optional<nlohmann::json> message;
+    std::string error;
+  };
+
+  // Deep enough that the reader runs ahead through a burst of changes
+  static constexpr size_t QUEUE_CAPACITY = 64;
+
+  static ParsedMessage parse(const std::string &body);
+  // Queues a parsed message with the scheduler
+  void receive(ParsedMessage &parsed);
+
   MessagesHandler messagesHandler;
   bool running;
   bool initialized = false;
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Orders a session's work on the message thread by priority class:
+//
+//   Interactive  hover, completion
+//   Normal       every other message, in arrival order
+//   Background   reassembly, indexing and diagnostics of a document
+//
+// An interactive request overtakes queued normal requests, but never a
+// notification before it, so it still sees every change sent ahead of it.
+// Background work runs once no message is waiting; a document's queued work
+// is replaced when it changes again, and work that has waited AGING_LIMIT
+// is run ahead of normal messages so steady typing can't starve it.
+//
+// Background work is a step that returns true while it has more to do. An
+// unfinished step goes to the back of the background queue, so long work
+// (see AssemblyJob) is interleaved with messages and other documents.
+class Scheduler {
+public:
+  enum class Priority { Interactive, Normal, Background };
+
+  using Task = std::function<void()>;
+  using Step = std::function<bool()>;
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::chrono::milliseconds AGING_LIMIT{250};
+
+  // Queues a message. Notifications are barriers: nothing queued after
+  // them is run before them.
+  void post(Priority priority, Task task, bool barrier) {
+    messages.push_back({priority, barrier, std::move(task)});
+  }
+
+  // Queues background work for key (a document URI), replacing work that
+  // is still queued for it. The replacement keeps the original age.
+  void postBackground(const std::string &key, Step step) {
+    auto it = backgroundByKey.find(key);
+    if (it != backgroundByKey.end()) {
+      it->second->step = std::move(step);
+      return;
+    }
+
+    queueBackground(key, std::move(step));
+  }
+
+  // Runs the background work queued for key to completion now, e.g. before
+  // a request that reads what it produces
+  void flush(const std::string &key) {
+    for (auto it = backgroundByKey.find(key); it != backgroundByKey.end();
+         it = backgroundByKey.find(key)) {
+      runBackground(it->second);
+    }
+  }
+
+  void flushAll() {
+    while (!background.empty()) {
+      runBackground(background.begin());
+    }
+  }
+
+  // Drops the background work queued for key, e.g. once it is closed
+  void cancel(const std::string &key) {
+    auto it = backgroundByKey.find(key);
+    if (it == backgroundByKey.end())
+      return;
+
+    background.erase(it->second);
+    backgroundByKey.erase(it);
+  }
+
+  bool hasMessages() const { return !messages.empty(); }
+  bool hasWork() const { return !messages.empty() || !background.empty(); }
+
+  // Runs the most urgent task; returns false if there was none
+  bool runNext() {
+    // An interactive request that is not behind a notification
+    for (auto it = messages.begin(); it != messages.end() && !it->barrier;
+         ++it) {
+      if (it->priority == Priority::Interactive) {
+        runMessage(it);
+        return true;
+      }
+    }
+
+    if (!background.empty() &&
+        Clock::now() - background.front().queuedAt >= AGING_LIMIT) {
+      runBackground(background.begin());
+      return true;
+    }
+
+    if (!messages.empty()) {
+      runMessage(messages.begin());
+      return true;
+    }
+
+    if (!background.empty()) {
+      runBackground(background.begin());
+      return true;
+    }
+
+    return false;
+  }
+
+private:
+  struct Message {
+    Priority priority;
+    bool barrier;
+    Task task;
+  };
+
+  struct BackgroundTask {
+    std::string key;
+    Step step;
+    Clock::time_point queuedAt;
+  };
+
+  std::deque<Message> messages;
+  std::list<BackgroundTask> background; // oldest first
+  std::unordered_map<std::string, std::list<BackgroundTask>::iterator>
+      backgroundByKey;
+
+  // Tasks are dequeued before they run, as they may queue or flush others
+  void runMessage(std::deque<Message>::iterator it) {
+    Task task = std::move(it->task);
+    messages.erase(it);
+    task();
+  }
+
+  void runBackground(std::list<BackgroundTask>::iterator it) {
+    std::string key = std::move(it->key);
+    Step step = std::move(it->step);
+    backgroundByKey.erase(key);
+    background.erase(it);
+
+    // Requeued as new, unless newer work for key was posted meanwhile
+    if (step() && !backgroundByKey.contains(key))
+      queueBackground(key, std::move(step));
+  }
+
+  void queueBackground(const std::string &key, Step step) {
+    background.push_back({key, std::move(step), Clock::now()});
+    backgroundByKey.emplace(key, std::prev(background.end()));
+  }
+};
@@ -0,0 +1,244 @@
+#include "./SocketServer.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int) { stopRequested = 1; }
+
+constexpr int MAX_EVENTS = 64;
+constexpr size_t READ_CHUNK = 64 * 1024;
+
+} // namespace
+
+SocketServer::~SocketServer() {
+  // Sessions first: their request workers may still write to the sockets
+  std::vector<int> fds;
+  for (const auto &session : sessions)
+    fds.push_back(session.first);
+  sessions.clear();
+  for (int fd : fds)
+    ::close(fd);
+
+  for (int fd : listeners)
+    ::close(fd);
+  if (epollFd >= 0)
+    ::close(epollFd);
+  if (!unixPath.empty())
+    ::unlink(unixPath.c_str());
+}
+
+bool SocketServer::listenUnix(const std::string &path) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path too long: " << path << "\n";
+    return false;
+  }
+
+  // A socket left behind by a previous run would make bind fail
+  struct stat st;
+  if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    ::unlink(path.c_str());
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    std::cerr << "socket: " << std::strerror(errno) << "\n";
+    return false;
+  }
+
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+          0 ||
+      ::listen(fd, SOMAXCONN) != 0) {
+    std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno)
+              << "\n";
+    ::close(fd);
+    return false;
+  }
+
+  unixPath = path;
+  return addListener(fd);
+}
+
+bool SocketServer::listenTcp(int port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    std::cerr << "socket: " << std::strerror(errno) << "\n";
+    return false;
+  }
+
+  int reuse = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  // Loopback only: the protocol has no authentication
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+          0 ||
+      ::listen(fd, SOMAXCONN) != 0) {
+    std::cerr << "Cannot listen on 127.0.0.1:" << port << ": "
+              << std::strerror(errno) << "\n";
+    ::close(fd);
+    return false;
+  }
+
+  return addListener(fd);
+}
+
+bool SocketServer::addListener(int fd) {
+  if (epollFd < 0)
+    epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  if (epollFd < 0 || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    std::cerr << "epoll: " << std::strerror(errno) << "\n";
+    ::close(fd);
+    return false;
+  }
+
+  listeners.push_back(fd);
+  return true;
+}
+
+int SocketServer::run() {
+  if (listeners.empty())
+    return 1;
+
+  // Without SA_RESTART, so epoll_wait returns and the loop can stop
+  struct sigaction action{};
+  action.sa_handler = requestStop;
+  sigemptyset(&action.sa_mask);
+  ::sigaction(SIGINT, &action, nullptr);
+  ::sigaction(SIGTERM, &action, nullptr);
+
+  epoll_event events[MAX_EVENTS];
+
+  while (!stopRequested) {
+    // Sessions with queued background work are stepped between events
+    bool pending = std::any_of(sessions.begin(), sessions.end(),
+                               [](const auto &session) {
+                                 return session.second->server.hasPendingWork();
+                               });
+
+    int count = ::epoll_wait(epollFd, events, MAX_EVENTS, pending ? 0 : -1);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "epoll_wait: " << std::strerror(errno) << "\n";
+      return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+      int fd = events[i].data.fd;
+
+      if (std::find(listeners.begin(), listeners.end(), fd) !=
+          listeners.end()) {
+        accept(fd);
+        continue;
+      }
+
+      auto it = sessions.find(fd);
+      if (it == sessions.end())
+        continue;
+
+      bool open = true;
+      if (events[i].events & EPOLLOUT)
+        open = it->second->io.flush();
+      if (open && (events[i].events & ~EPOLLOUT))
+        open = read(fd, *it->second);
+      if (!open)
+        close(fd);
+    }
+
+    for (auto &session : sessions) {
+      if (session.second->server.hasPendingWork())
+        session.second->server.runPending();
+    }
+
+    // Writes from the request workers can fail too
+    std::vector<int> broken;
+    for (const auto &session : sessions) {
+      if (session.second->io.isBroken())
+        broken.push_back(session.first);
+    }
+    for (int fd : broken)
+      close(fd);
+  }
+
+  return 0;
+}
+
+void SocketServer::accept(int listener) {
+  while (true) {
+    int fd = ::accept4(listener, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      // EAGAIN: every pending connection was taken
+      return;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      ::close(fd);
+      continue;
+    }
+
+    sessions.emplace(fd, std::make_unique<Session>(fd, epollFd, sharedState));
+  }
+}
+
+bool SocketServer::read(int fd, Session &session) {
+  char buffer[READ_CHUNK];
+
+  // Drain the socket, then handle every complete message it held
+  bool open = true;
+  while (true) {
+    ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      session.framer.feed(buffer, static_cast<size_t>(n));
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      open = false;
+    break;
+  }
+
+  while (auto body = session.framer.next()) {
+    if (!session.server.handleMessage(*body) || session.io.isBroken())
+      return false;
+  }
+
+  return open && !session.framer.failed();
+}
+
+void SocketServer::close(int fd) {
+  ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  sessions.erase(fd);
+  ::close(fd);
+}
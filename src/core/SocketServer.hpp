@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core/LanguageServer.hpp"
+#include "core/transport/MessageFramer.hpp"
+#include "core/transport/SocketIO.hpp"
+#include "hack/SharedState.hpp"
+
+// Daemon mode (--socket / --port): accepts editor connections on a Unix
+// domain socket and/or a loopback TCP port and runs each as its own
+// LanguageServer session. One epoll loop reads every connection, so the
+// sessions' message handling never runs concurrently; only their request
+// workers and the SharedState they all see (workspace indexes, the result
+// pool) are touched from other threads.
+class SocketServer {
+public:
+  explicit SocketServer(SharedState &_sharedState)
+      : sharedState(_sharedState) {}
+  ~SocketServer();
+
+  SocketServer(const SocketServer &) = delete;
+  SocketServer &operator=(const SocketServer &) = delete;
+
+  // Both return false (after printing why) if the listener can't be set up
+  bool listenUnix(const std::string &path);
+  bool listenTcp(int port);
+
+  // Serves connections until SIGINT or SIGTERM; returns the exit code
+  int run();
+
+private:
+  struct Session {
+    Session(int fd, int epollFd, SharedState &sharedState)
+        : io(fd, epollFd), server(io, sharedState) {}
+
+    SocketIO io;
+    LanguageServer server;
+    MessageFramer framer;
+  };
+
+  SharedState &sharedState;
+  int epollFd = -1;
+  std::vector<int> listeners;
+  std::string unixPath; // unlinked on shutdown
+  std::unordered_map<int, std::unique_ptr<Session>> sessions;
+
+  bool addListener(int fd);
+  void accept(int listener);
+  // Returns false once the session is finished
+  bool read(int fd, Session &session);
+  void close(int fd);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads running read-only requests, so a slow completion
+// doesn't hold up the hover behind it. Jobs only see immutable snapshots
+// taken on the message thread; responses go out in completion order.
+class WorkerPool {
+public:
+  // Requests are short; a few threads keep a burst from queueing
+  static constexpr unsigned MAX_THREADS = 4;
+
+  WorkerPool() {
+    unsigned threadCount =
+        std::clamp(std::thread::hardware_concurrency(), 1u, MAX_THREADS);
+
+    workers.reserve(threadCount);
+    for (unsigned t = 0; t < threadCount; t++) {
+      workers.emplace_back(&WorkerPool::run, this);
+    }
+  }
+
+  // Runs the jobs still queued, so every dispatched request is answered
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  void submit(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    wakeUp.notify_one();
+  }
+
+private:
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  std::deque<std::function<void()>> jobs;
+  bool stopping = false;
+
+  void run() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeUp.wait(lock, [&] { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+          return;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+
+      job();
+    }
+  }
+};
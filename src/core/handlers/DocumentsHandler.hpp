@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -9,36 +10,48 @@
 #include "lsp/errors.hpp"
 #include "lsp/params.hpp"
 
+// One version of a document. Snapshots are never modified: a change builds
+// the next version and swaps it in, so a reader keeps the text it started
+// with for as long as it holds the pointer, on any thread.
+using DocumentSnapshot = std::shared_ptr<const TextDocument>;
+
 class DocumentsHandler {
 
 public:
   void onOpen(lsp::DidOpenParams params) {
 
-    auto textDocument =
-        TextDocument{params.textDocument.uri, params.textDocument.version,
-                     params.textDocument.text};
+    auto textDocument = std::make_shared<const TextDocument>(
+        params.textDocument.uri, params.textDocument.version,
+        std::move(params.textDocument.text));
     {
       std::lock_guard<std::mutex> lock(mutex);
-      uriToDocuments.emplace(params.textDocument.uri, textDocument);
+      uriToDocuments.emplace(params.textDocument.uri, std::move(textDocument));
     }
   };
 
-  void onChange(lsp::DidChangeParams params) {
+  std::vector<LineSplice> onChange(lsp::DidChangeParams params) {
 
-    std::lock_guard<std::mutex> lock(mutex);
+    DocumentSnapshot current = find(params.textDocument.uri);
 
-    auto it = uriToDocuments.find(params.textDocument.uri);
-
-    if (it == uriToDocuments.end()) {
+    if (current == nullptr) {
       lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
       throw error;
     }
 
-    TextDocument &textDocument = it->second;
-    if (params.textDocument.version > textDocument.version) {
-      textDocument.applyChanges(params.contentChanges);
-      textDocument.version = params.textDocument.version;
+    if (params.textDocument.version <= current->version)
+      return {};
+
+    // Changes arrive on one thread, so only the swap needs the lock
+    auto next = std::make_shared<TextDocument>(*current);
+    auto splices = next->applyChanges(params.contentChanges);
+    next->version = params.textDocument.version;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      uriToDocuments.insert_or_assign(params.textDocument.uri,
+                                      std::move(next));
     }
+    return splices;
   };
 
   void onClose(lsp::DidCloseParams params) {
@@ -52,28 +65,48 @@ public:
       throw error;
     }
 
-    uriToDocuments.erase(params.textDocument.uri);
+    uriToDocuments.erase(it);
   }
 
-  const std::string &getText(const std::string &uri) {
+  // The current version of uri, or nullptr if it is not open
+  DocumentSnapshot find(const std::string &uri) {
 
     std::lock_guard<std::mutex> lock(mutex);
 
     auto it = uriToDocuments.find(uri);
-    if (it == uriToDocuments.end()) {
+    if (it == uriToDocuments.end())
+      return nullptr;
+    return it->second;
+  }
+
+  // Like find(), for documents a request requires to be open
+  DocumentSnapshot snapshot(const std::string &uri) {
+
+    DocumentSnapshot document = find(uri);
+    if (document == nullptr) {
       lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR,
                        "URI not found in documents");
       throw error;
     }
-    TextDocument &textDocument = it->second;
-    return textDocument.text;
+    return document;
   }
 
-  const std::unordered_map<std::string, TextDocument> &getDocuments() {
-    return uriToDocuments;
+  bool contains(const std::string &uri) { return find(uri) != nullptr; }
+
+  // The current version of every open document
+  std::vector<DocumentSnapshot> snapshots() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<DocumentSnapshot> documents;
+    documents.reserve(uriToDocuments.size());
+    for (const auto &entry : uriToDocuments) {
+      documents.push_back(entry.second);
+    }
+    return documents;
   }
 
 private:
-  std::unordered_map<std::string, TextDocument> uriToDocuments;
+  std::unordered_map<std::string, DocumentSnapshot> uriToDocuments;
   std::mutex mutex;
-};
\ No newline at end of file
+};
@@ -6,8 +6,31 @@
 #include "lsp/protocol.hpp"
 #include "lsp/responses.hpp"
 
+void MessagesHandler::receive(nlohmann::json message) {
+  auto priority = Scheduler::Priority::Normal;
+
+  auto method = message.find("method");
+  if (message.contains("id") && method != message.end() &&
+      method->is_string() && isInteractive(method->get<std::string>()))
+    priority = Scheduler::Priority::Interactive;
+
+  // Notifications change state that later messages expect to see
+  bool barrier = !message.contains("id");
+
+  scheduler.post(
+      priority,
+      [this, message = std::move(message)]() mutable { process(message); },
+      barrier);
+}
+
 int MessagesHandler::process(nlohmann::json &message) {
 
+  // Responses to server-initiated requests (client/registerCapability) need
+  // no handling
+  if (message.contains("id") && !message.contains("method") &&
+      (message.contains("result") || message.contains("error")))
+    return 0;
+
   if (!validateMessage(message))
     return 0;
 
@@ -46,19 +69,88 @@ int MessagesHandler::processRequest(nlohmann::json &message) {
       return 1;
     }
 
+    if (!isInteractive(req.method))
+      settle(req);
+
+    // Answered on the workers, possibly after requests received later
     if (req.method == "textDocument/hover") {
-      lsp::HoverResult result = hover(req);
-      send_response(req.id, lsp::Result(result));
+      dispatch(req.id, hover(req));
       return 0;
     }
 
     if (req.method == "textDocument/completion") {
-      lsp::CompletionResult result = completion(req);
+      dispatch(req.id, completion(req));
+      return 0;
+    }
+
+    if (req.method == "hack/run") {
+      dispatch(req.id, run(req));
+      return 0;
+    }
+
+    if (req.method == "textDocument/prepareRename") {
+      lsp::PrepareRenameResult result = prepareRename(req);
       send_response(req.id, lsp::Result(result));
       return 0;
     }
 
+    if (req.method == "textDocument/rename") {
+      lsp::RawResult result = rename(req);
+      send_response(req.id, lsp::Result(std::move(result)));
+      return 0;
+    }
+
+    if (req.method.starts_with("textDocument/semanticTokens/")) {
+      lsp::RawResult result = semanticTokens(req);
+      send_response(req.id, lsp::Result(std::move(result)));
+      return 0;
+    }
+
+    if (req.method == "textDocument/diagnostic") {
+      lsp::RawResult result = documentDiagnostic(req);
+      send_response(req.id, lsp::Result(std::move(result)));
+      return 0;
+    }
+
+    // Held, and answered later, while no report has changed
+    if (req.method == "workspace/diagnostic") {
+      if (auto result = workspaceDiagnostic(req))
+        send_response(req.id, lsp::Result(std::move(*result)));
+      return 0;
+    }
+
+    if (req.method == "textDocument/inlayHint") {
+      lsp::RawResult result = inlayHint(req);
+      send_response(req.id, lsp::Result(std::move(result)));
+      return 0;
+    }
+
+    if (req.method == "hack/assembledOutput") {
+      lsp::RawResult result = assembledOutput(req);
+      send_response(req.id, lsp::Result(std::move(result)));
+      return 0;
+    }
+
+    if (req.method == "textDocument/formatting") {
+      lsp::RawResult result = formatting(req);
+      send_response(req.id, lsp::Result(std::move(result)));
+      return 0;
+    }
+
+    if (req.method == "textDocument/rangeFormatting") {
+      lsp::RawResult result = rangeFormatting(req);
+      send_response(req.id, lsp::Result(std::move(result)));
+      return 0;
+    }
+
+    if (req.method == "workspace/symbol") {
+      lsp::WorkspaceSymbolResult result = workspaceSymbol(req);
+      send_response(req.id, lsp::Result(std::move(result)));
+      return 0;
+    }
+
     if (req.method == "shutdown") {
+      hackManager.answerHeldRequests();
       server.onShutdown();
       send_response(req.id, lsp::Result(nullptr));
       return 0;
@@ -107,6 +199,12 @@ int MessagesHandler::handleNotification(nlohmann::json &message) {
     if (notif.method == "textDocument/didClose")
       return didClose(notif);
 
+    if (notif.method == "workspace/didChangeWatchedFiles")
+      return didChangeWatchedFiles(notif);
+
+    if (notif.method == "$/cancelRequest")
+      return cancelRequest(notif);
+
     logError(MessageType::Error, lsp::ErrorCode::METHOD_NOT_FOUND,
              notif.method.c_str());
     return 1;
@@ -125,21 +223,40 @@ int MessagesHandler::handleNotification(nlohmann::json &message) {
   }
 }
 
-lsp::InitializeResult MessagesHandler::initialize(lsp::RequestMessage &) {
+lsp::InitializeResult MessagesHandler::initialize(lsp::RequestMessage &req) {
+
+  lsp::InitializeParams params(req.params);
+
+  hackManager.setPullDiagnostics(params.capabilities.diagnosticPull);
+
+  // initializationOptions.memoryBudgetMB caps the cached assembler results
+  if (params.initializationOptions &&
+      params.initializationOptions->is_object()) {
+    const auto &options = *params.initializationOptions;
+    if (options.contains("memoryBudgetMB") &&
+        options.at("memoryBudgetMB").is_number_unsigned()) {
+      hackManager.setMemoryBudget(
+          options.at("memoryBudgetMB").get<size_t>() * 1024 * 1024);
+    }
+  }
+
+  // Index the workspace in the background so unopened files are known too,
+  // and keep assembler results in its disk cache
+  if (std::holds_alternative<lsp::DocumentUri>(params.rootUri)) {
+    hackManager.indexWorkspace(std::get<lsp::DocumentUri>(params.rootUri));
+    watchFiles = params.capabilities.watchedFilesDynamicRegistration;
+  }
 
   lsp::InitializeResult result = protocol::serverDetails::to_json();
   server.allowNotifications();
   return result;
 }
 
-lsp::CompletionResult MessagesHandler::completion(lsp::RequestMessage &req) {
+CompletionEngine::Job MessagesHandler::completion(lsp::RequestMessage &req) {
 
   lsp::CompletionParams params(req.params);
 
-  auto &documents = documentsHandler.getDocuments();
-  auto it = documents.find(params.textDocument.uri);
-
-  if (it == documents.end()) {
+  if (!documentsHandler.contains(params.textDocument.uri)) {
     lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
     throw error;
   }
@@ -147,14 +264,11 @@ lsp::CompletionResult MessagesHandler::completion(lsp::RequestMessage &req) {
   return hackManager.completion(params);
 }
 
-lsp::HoverResult MessagesHandler::hover(lsp::RequestMessage &req) {
+HoverEngine::Job MessagesHandler::hover(lsp::RequestMessage &req) {
 
   lsp::HoverParams params(req.params);
 
-  auto &documents = documentsHandler.getDocuments();
-  auto it = documents.find(params.textDocument.uri);
-
-  if (it == documents.end()) {
+  if (!documentsHandler.contains(params.textDocument.uri)) {
     lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
     throw error;
   }
@@ -162,9 +276,158 @@ lsp::HoverResult MessagesHandler::hover(lsp::RequestMessage &req) {
   return hackManager.hover(params);
 }
 
+lsp::PrepareRenameResult
+MessagesHandler::prepareRename(lsp::RequestMessage &req) {
+
+  lsp::PrepareRenameParams params(req.params);
+
+  if (!documentsHandler.contains(params.textDocument.uri)) {
+    lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+    throw error;
+  }
+
+  return hackManager.prepareRename(params);
+}
+
+lsp::RawResult MessagesHandler::rename(lsp::RequestMessage &req) {
+
+  lsp::RenameParams params(req.params);
+
+  if (!documentsHandler.contains(params.textDocument.uri)) {
+    lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+    throw error;
+  }
+
+  return hackManager.rename(params);
+}
+
+lsp::RawResult MessagesHandler::semanticTokens(lsp::RequestMessage &req) {
+
+  std::string uri = req.params.at("textDocument").at("uri").get<std::string>();
+
+  if (!documentsHandler.contains(uri)) {
+    lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+    throw error;
+  }
+
+  if (req.method == "textDocument/semanticTokens/full") {
+    lsp::SemanticTokensParams params(req.params);
+    return hackManager.semanticTokensFull(params);
+  }
+
+  if (req.method == "textDocument/semanticTokens/range") {
+    lsp::SemanticTokensRangeParams params(req.params);
+    return hackManager.semanticTokensRange(params);
+  }
+
+  if (req.method == "textDocument/semanticTokens/full/delta") {
+    lsp::SemanticTokensDeltaParams params(req.params);
+    return hackManager.semanticTokensDelta(params);
+  }
+
+  lsp::Error error(lsp::ErrorCode::METHOD_NOT_FOUND,
+                   lsp::getErrorMessage(lsp::ErrorCode::METHOD_NOT_FOUND));
+  throw error;
+}
+
+lsp::RawResult MessagesHandler::documentDiagnostic(lsp::RequestMessage &req) {
+
+  lsp::DocumentDiagnosticParams params(req.params);
+  return hackManager.documentDiagnostic(params);
+}
+
+std::optional<lsp::RawResult>
+MessagesHandler::workspaceDiagnostic(lsp::RequestMessage &req) {
+
+  lsp::WorkspaceDiagnosticParams params(req.params);
+  return hackManager.workspaceDiagnostic(req.id, params);
+}
+
+lsp::RawResult MessagesHandler::inlayHint(lsp::RequestMessage &req) {
+
+  lsp::InlayHintParams params(req.params);
+
+  if (!documentsHandler.contains(params.textDocument.uri)) {
+    lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+    throw error;
+  }
+
+  return hackManager.inlayHints(params);
+}
+
+lsp::RawResult MessagesHandler::assembledOutput(lsp::RequestMessage &req) {
+
+  lsp::AssembledOutputParams params(req.params);
+
+  if (!documentsHandler.contains(params.textDocument.uri)) {
+    lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+    throw error;
+  }
+
+  return hackManager.assembledOutput(params);
+}
+
+RunEngine::Job MessagesHandler::run(lsp::RequestMessage &req) {
+
+  lsp::RunParams params(req.params);
+
+  if (!documentsHandler.contains(params.textDocument.uri)) {
+    lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+    throw error;
+  }
+
+  return hackManager.run(params);
+}
+
+lsp::RawResult MessagesHandler::formatting(lsp::RequestMessage &req) {
+
+  lsp::DocumentFormattingParams params(req.params);
+
+  if (!documentsHandler.contains(params.textDocument.uri)) {
+    lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+    throw error;
+  }
+
+  return hackManager.formatting(params);
+}
+
+lsp::RawResult MessagesHandler::rangeFormatting(lsp::RequestMessage &req) {
+
+  lsp::DocumentRangeFormattingParams params(req.params);
+
+  if (!documentsHandler.contains(params.textDocument.uri)) {
+    lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+    throw error;
+  }
+
+  return hackManager.rangeFormatting(params);
+}
+
+lsp::WorkspaceSymbolResult
+MessagesHandler::workspaceSymbol(lsp::RequestMessage &req) {
+
+  lsp::WorkspaceSymbolParams params(req.params);
+  return hackManager.workspaceSymbols(params);
+}
+
 int MessagesHandler::initialized() {
 
   server.onInitialize();
+
+  if (watchFiles) {
+    nlohmann::ordered_json watcher;
+    watcher["globPattern"] = protocol::serverDetails::WATCHED_FILES_GLOB;
+
+    nlohmann::ordered_json registration;
+    registration["id"] = "hack-ls-watched-files";
+    registration["method"] = "workspace/didChangeWatchedFiles";
+    registration["registerOptions"]["watchers"] = {watcher};
+
+    nlohmann::ordered_json params;
+    params["registrations"] = {registration};
+    io.sendRequest("client/registerCapability", params);
+  }
+
   return 0;
 }
 
@@ -175,7 +438,7 @@ int MessagesHandler::didOpen(lsp::NotificationMessage &notif) {
   std::string uri = didOpenParams.textDocument.uri;
 
   documentsHandler.onOpen(didOpenParams);
-  hackManager.processDocument(uri);
+  hackManager.openDocument(uri);
 
   return 0;
 }
@@ -186,8 +449,9 @@ int MessagesHandler::didChange(lsp::NotificationMessage &notif) {
   lsp::DidChangeParams didChangeParams(_params);
   std::string uri = didChangeParams.textDocument.uri;
 
-  documentsHandler.onChange(didChangeParams);
-  hackManager.processDocument(uri);
+  auto previous = documentsHandler.find(uri);
+  auto splices = documentsHandler.onChange(didChangeParams);
+  hackManager.processDocument(uri, splices, previous);
 
   return 0;
 }
@@ -197,9 +461,27 @@ int MessagesHandler::didClose(lsp::NotificationMessage &notif) {
   lsp::DidCloseParams didCloseParams(_params);
   std::string uri = didCloseParams.textDocument.uri;
 
-  documentsHandler.onClose(didCloseParams);
+  // The closed text's result and symbols go to the disk cache first
   hackManager.freeURIResult(uri);
+  documentsHandler.onClose(didCloseParams);
+
+  return 0;
+}
+
+int MessagesHandler::didChangeWatchedFiles(lsp::NotificationMessage &notif) {
+  auto _params = notif.params.value();
+  lsp::DidChangeWatchedFilesParams didChangeWatchedFilesParams(_params);
+
+  hackManager.onWatchedFilesChanged(didChangeWatchedFilesParams);
+
+  return 0;
+}
 
+// Requests are answered as they are handled, except a held
+// workspace/diagnostic, which is the only one a cancel can still reach
+int MessagesHandler::cancelRequest(lsp::NotificationMessage &notif) {
+  auto params = notif.params.value();
+  hackManager.cancelRequest(params.at("id"));
   return 0;
 }
 
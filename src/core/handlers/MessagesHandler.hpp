@@ -2,10 +2,13 @@
 
 #include <optional>
 
+#include "core/Scheduler.hpp"
+#include "core/WorkerPool.hpp"
 #include "core/handlers/DocumentsHandler.hpp"
 #include "core/interfaces/IMessage.hpp"
 #include "core/interfaces/IServerState.hpp"
 #include "hack/HackManager.hpp"
+#include "hack/SharedState.hpp"
 #include "lsp/errors.hpp"
 #include "lsp/messages.hpp"
 #include "lsp/responses.hpp"
@@ -14,15 +17,23 @@
 class MessagesHandler {
 
 public:
-  MessagesHandler(IServerState &_server, IMessage &_io)
-      : server(_server), io(_io), hackManager(documentsHandler, _io) {};
+  MessagesHandler(IServerState &_server, IMessage &_io,
+                  SharedState &_sharedState)
+      : server(_server), io(_io),
+        hackManager(documentsHandler, _io, _sharedState, scheduler) {};
 
   ~MessagesHandler() {
     // Free all assembler results on shutdown to prevent memory leaks
     hackManager.freeAllResults();
   }
 
-  int process(nlohmann::json &_message);
+  // Queues a message by priority; it is handled from runNext()
+  void receive(nlohmann::json message);
+
+  // Runs the most urgent queued message or background task; false if none
+  bool runNext() { return scheduler.runNext(); }
+  bool hasMessages() const { return scheduler.hasMessages(); }
+  bool hasWork() const { return scheduler.hasWork(); }
 
   // Send a logMessage notification
   void logMessage(MessageType type, const std::string &message);
@@ -34,21 +45,39 @@ private:
   IServerState &server;
   IMessage &io;
   DocumentsHandler documentsHandler;
+  Scheduler scheduler;
   HackManager hackManager;
+  bool watchFiles = false;
+  // Declared last: joined before anything its jobs use is destroyed
+  WorkerPool workers;
 
+  int process(nlohmann::json &_message);
   int processRequest(nlohmann::json &message);
   int handleNotification(nlohmann::json &message);
 
   // requests
   lsp::InitializeResult initialize(lsp::RequestMessage &req);
-  lsp::CompletionResult completion(lsp::RequestMessage &req);
-  lsp::HoverResult hover(lsp::RequestMessage &req);
+  CompletionEngine::Job completion(lsp::RequestMessage &req);
+  HoverEngine::Job hover(lsp::RequestMessage &req);
+  lsp::PrepareRenameResult prepareRename(lsp::RequestMessage &req);
+  lsp::RawResult rename(lsp::RequestMessage &req);
+  lsp::WorkspaceSymbolResult workspaceSymbol(lsp::RequestMessage &req);
+  lsp::RawResult semanticTokens(lsp::RequestMessage &req);
+  lsp::RawResult formatting(lsp::RequestMessage &req);
+  lsp::RawResult documentDiagnostic(lsp::RequestMessage &req);
+  lsp::RawResult assembledOutput(lsp::RequestMessage &req);
+  RunEngine::Job run(lsp::RequestMessage &req);
+  lsp::RawResult inlayHint(lsp::RequestMessage &req);
+  std::optional<lsp::RawResult> workspaceDiagnostic(lsp::RequestMessage &req);
+  lsp::RawResult rangeFormatting(lsp::RequestMessage &req);
 
   // notifications
   int initialized();
   int didOpen(lsp::NotificationMessage &notif);
   int didChange(lsp::NotificationMessage &notif);
   int didClose(lsp::NotificationMessage &notif);
+  int didChangeWatchedFiles(lsp::NotificationMessage &notif);
+  int cancelRequest(lsp::NotificationMessage &notif);
 
   int validateMessage(nlohmann::json &message) {
     try {
@@ -68,6 +97,42 @@ private:
     }
   }
 
+  // Hover and completion answer from the state they find and may overtake
+  // queued requests (see Scheduler)
+  static bool isInteractive(const std::string &method) {
+    return method == "textDocument/hover" ||
+           method == "textDocument/completion";
+  }
+
+  // Runs the background work a request's document is waiting on, or all of
+  // it for requests that are not about one document
+  void settle(const lsp::RequestMessage &req) {
+    if (req.params.is_object() && req.params.contains("textDocument") &&
+        req.params.at("textDocument").is_object() &&
+        req.params.at("textDocument").contains("uri") &&
+        req.params.at("textDocument").at("uri").is_string()) {
+      scheduler.flush(
+          req.params.at("textDocument").at("uri").get<std::string>());
+      return;
+    }
+    scheduler.flushAll();
+  }
+
+  // Runs a prepared job on the workers and answers from there
+  template <typename Job> void dispatch(const nlohmann::json &id, Job job) {
+    workers.submit([this, id, job = std::move(job)] {
+      try {
+        send_response(id, lsp::Result(job()));
+
+      } catch (const lsp::Error &e) {
+        send_response(id, e.code, e.what(), e.data);
+
+      } catch (const std::exception &e) {
+        send_response(id, lsp::ErrorCode::INTERNAL_ERROR, e.what());
+      }
+    });
+  }
+
   void send_response(const nlohmann::json &id,
                      const lsp::Result &result) noexcept {
     io.sendMessage(id, std::variant<lsp::Result, lsp::Error>(result));
@@ -12,5 +12,9 @@ public:
   virtual void sendNotification(const std::string &method,
                                 const nlohmann::ordered_json &params) = 0;
 
+  // Server-initiated request; the client's response is not awaited
+  virtual void sendRequest(const std::string &method,
+                           const nlohmann::ordered_json &params) = 0;
+
   virtual ~IMessage() = default;
 };
\ No newline at end of file
@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <cstddef>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -37,14 +40,130 @@ size_t TextDocument::positionToOffset(const lsp::Position &position) const {
   return offset + utf8CharPos;
 }
 
-void TextDocument::applyChanges(
+// Like positionToOffset, using an index of line start offsets, but nullopt
+// instead of clamping a position that is past the end of its line or the
+// text
+std::optional<size_t>
+TextDocument::exactOffset(const std::vector<size_t> &lineStarts,
+                          const lsp::Position &position) const {
+  if (position.line < 0 || position.character < 0 ||
+      static_cast<size_t>(position.line) >= lineStarts.size())
+    return std::nullopt;
+
+  size_t offset = lineStarts[position.line];
+  size_t lineEnd = static_cast<size_t>(position.line) + 1 < lineStarts.size()
+                       ? lineStarts[position.line + 1] - 1
+                       : text.size();
+  size_t character = static_cast<size_t>(position.character);
+
+  // Plain ASCII up to the position: UTF-16 columns are byte offsets
+  std::string_view line(text.data() + offset, lineEnd - offset);
+  size_t prefix = std::min(character, line.size());
+  if (std::all_of(line.begin(), line.begin() + prefix,
+                  [](char c) { return static_cast<unsigned char>(c) < 0x80; }))
+    return character <= line.size() ? std::optional(offset + character)
+                                    : std::nullopt;
+
+  // A column inside a surrogate pair has no exact offset either
+  std::string lineText(line);
+  size_t byte = utf16_to_utf8::utf16CodeUnitsToUtf8Offset(lineText, character);
+  if (utf16_to_utf8::getUtf16CodeUnitCountUpToOffset(lineText, byte) !=
+      character)
+    return std::nullopt;
+  return offset + byte;
+}
+
+// Multi-cursor edits and replace-all arrive as several ranged changes, each
+// meant for the text the changes before it left. If every change ends where
+// or before the previous one starts, no change moves the text a later one
+// refers to, so all ranges are resolved against the current text and the
+// new text is built in one sweep. Returns false, leaving the text as it was,
+// for any other batch.
+bool TextDocument::applyBatch(
+    const std::vector<lsp::TextDocumentContentChangeEvent> &changes) {
+
+  std::vector<size_t> lineStarts{0};
+  for (size_t i = text.find('\n'); i != std::string::npos;
+       i = text.find('\n', i + 1)) {
+    lineStarts.push_back(i + 1);
+  }
+
+  struct Edit {
+    size_t start;
+    size_t end;
+    const std::string *text;
+  };
+
+  std::vector<Edit> edits;
+  edits.reserve(changes.size());
+
+  size_t limit = text.size();
+  size_t size = text.size();
+  for (const auto &change : changes) {
+    auto *rangedChange =
+        std::get_if<lsp::TextDocumentContentChangeEventWithRange>(&change);
+    if (rangedChange == nullptr)
+      return false;
+
+    auto start = exactOffset(lineStarts, rangedChange->range.start);
+    auto end = exactOffset(lineStarts, rangedChange->range.end);
+    if (!start || !end || *start > *end || *end > limit)
+      return false;
+
+    edits.push_back({*start, *end, &rangedChange->text});
+    size = size - (*end - *start) + rangedChange->text.size();
+    limit = *start;
+  }
+
+  // Edits are in descending order; the last one applied comes first
+  std::string next;
+  next.reserve(size);
+  size_t copied = 0;
+  for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+    next.append(text, copied, it->start - copied);
+    next += *it->text;
+    copied = it->end;
+  }
+  next.append(text, copied);
+
+  text = std::move(next);
+  return true;
+}
+
+std::vector<LineSplice> TextDocument::applyChanges(
     std::vector<lsp::TextDocumentContentChangeEvent> changes) {
 
+  auto lineCount = [](const std::string &s) {
+    return static_cast<int>(std::count(s.begin(), s.end(), '\n')) + 1;
+  };
+
+  auto rangedSplice =
+      [&](const lsp::TextDocumentContentChangeEventWithRange &rangedChange) {
+        return LineSplice{
+            rangedChange.range.start.line,
+            rangedChange.range.end.line - rangedChange.range.start.line + 1,
+            lineCount(rangedChange.text)};
+      };
+
+  std::vector<LineSplice> splices;
+  splices.reserve(changes.size());
+
+  // The ranges are unchanged by the batch, and so are the splices
+  if (changes.size() > 1 && applyBatch(changes)) {
+    for (const auto &change : changes) {
+      splices.push_back(rangedSplice(
+          std::get<lsp::TextDocumentContentChangeEventWithRange>(change)));
+    }
+    return splices;
+  }
+
   for (const auto &change : changes) {
     if (std::holds_alternative<lsp::TextDocumentContentChangeEventFull>(
             change)) {
 
+      int removedLines = lineCount(text);
       text = std::get<lsp::TextDocumentContentChangeEventFull>(change).text;
+      splices.push_back({0, removedLines, lineCount(text)});
       continue;
     }
 
@@ -56,5 +175,8 @@ void TextDocument::applyChanges(
     size_t endOffset = positionToOffset(rangedChange.range.end);
 
     text.replace(startOffset, endOffset - startOffset, rangedChange.text);
+    splices.push_back(rangedSplice(rangedChange));
   }
+
+  return splices;
 }
@@ -1,10 +1,32 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "lsp/types.hpp"
 
+// Lines [startLine, startLine + removedLines) of the previous text were
+// replaced by addedLines lines of new text
+struct LineSplice {
+  int startLine;
+  int removedLines;
+  int addedLines;
+
+  // One splice covering this one and next, which is relative to the text
+  // this one left
+  LineSplice then(const LineSplice &next) const {
+    int start = std::min(startLine, next.startLine);
+    int end =
+        std::max(startLine + addedLines, next.startLine + next.removedLines);
+    int endBefore = end - addedLines + removedLines;
+    int endAfter = end + next.addedLines - next.removedLines;
+    return {start, endBefore - start, endAfter - start};
+  }
+};
+
 struct TextDocument {
   size_t positionToOffset(const lsp::Position &position) const;
 
@@ -16,5 +38,14 @@ public:
   TextDocument(std::string uri, int version, std::string text)
       : uri(uri), version(version), text(text) {}
 
-  void applyChanges(std::vector<lsp::TextDocumentContentChangeEvent>);
+  // Returns the line ranges touched by the changes, in application order
+  std::vector<LineSplice>
+      applyChanges(std::vector<lsp::TextDocumentContentChangeEvent>);
+
+private:
+  bool applyBatch(
+      const std::vector<lsp::TextDocumentContentChangeEvent> &changes);
+
+  std::optional<size_t> exactOffset(const std::vector<size_t> &lineStarts,
+                                    const lsp::Position &position) const;
 };
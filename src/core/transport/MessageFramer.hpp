@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Splits a byte stream into LSP message bodies for non-blocking transports,
+// where a read may end anywhere inside a header or a body. Bytes are fed as
+// they arrive and complete bodies are taken out with next().
+class MessageFramer {
+public:
+  void feed(const char *data, size_t size) {
+    // Compact once the consumed prefix dominates the buffer
+    if (consumed > 0 && consumed >= buffer.size() / 2) {
+      buffer.erase(0, consumed);
+      consumed = 0;
+    }
+    buffer.append(data, size);
+  }
+
+  // The next complete body, an empty string for a message without one, or
+  // nullopt if more bytes are needed or the stream is malformed (failed())
+  std::optional<std::string> next() {
+    if (broken)
+      return std::nullopt;
+
+    std::string_view pending = std::string_view(buffer).substr(consumed);
+
+    // Headers end with an empty line; CRLF and bare LF are both accepted
+    size_t contentLength = 0;
+    size_t offset = 0;
+    while (true) {
+      size_t newline = pending.find('\n', offset);
+      if (newline == std::string_view::npos) {
+        if (pending.size() > MAX_HEADER_BYTES)
+          broken = true;
+        return std::nullopt;
+      }
+
+      std::string_view line = pending.substr(offset, newline - offset);
+      offset = newline + 1;
+      if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+
+      if (line.empty())
+        break;
+
+      if (!parseHeader(line, contentLength)) {
+        broken = true;
+        return std::nullopt;
+      }
+    }
+
+    if (pending.size() - offset < contentLength)
+      return std::nullopt;
+
+    consumed += offset + contentLength;
+    return std::string(pending.substr(offset, contentLength));
+  }
+
+  bool failed() const { return broken; }
+
+private:
+  static constexpr size_t MAX_HEADER_BYTES = 64 * 1024;
+
+  std::string buffer;
+  size_t consumed = 0;
+  bool broken = false;
+
+  // Content-Length is the only header that matters; others are skipped
+  static bool parseHeader(std::string_view line, size_t &contentLength) {
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos)
+      return true;
+
+    std::string_view key = trim(line.substr(0, colon));
+    std::string_view value = trim(line.substr(colon + 1));
+
+    static constexpr std::string_view CONTENT_LENGTH = "content-length";
+    if (key.size() != CONTENT_LENGTH.size())
+      return true;
+    for (size_t i = 0; i < key.size(); i++) {
+      if (std::tolower(static_cast<unsigned char>(key[i])) != CONTENT_LENGTH[i])
+        return true;
+    }
+
+    const char *last = value.data() + value.size();
+    auto [ptr, ec] = std::from_chars(value.data(), last, contentLength);
+    return ec == std::errc() && ptr == last;
+  }
+
+  static std::string_view trim(std::string_view text) {
+    size_t start = text.find_first_not_of(" \t");
+    if (start == std::string_view::npos)
+      return {};
+    size_t end = text.find_last_not_of(" \t");
+    return text.substr(start, end - start + 1);
+  }
+};
@@ -2,18 +2,21 @@
 
 #include <iostream>
 #include <map>
-#include <mutex>
+#include <optional>
 #include <string>
-#include <variant>
 
-#include "core/interfaces/IMessage.hpp"
-#include "lsp/errors.hpp"
-#include "lsp/responses.hpp"
-#include <nlohmann/json.hpp>
+#include "core/transport/MessageWriter.hpp"
 
-class MessageIO : public IMessage {
+// LSP over stdin/stdout
+class MessageIO : public MessageWriter {
 public:
-  std::optional<std::string> readMessage() noexcept {
+  // Reads and writes happen on different threads; an input operation must
+  // not flush std::cout behind the writer's lock
+  MessageIO() { std::cin.tie(nullptr); }
+
+  // Static, as it only reads std::cin: a reader thread that outlives the
+  // session holds no reference to it
+  static std::optional<std::string> readMessage() noexcept {
     std::map<std::string, std::string> headers;
     std::string line;
 
@@ -29,7 +32,7 @@ public:
     }
 
     // If EOF before finishing headers
-    if (!std::cin && line != "")
+    if (!std::cin)
       return std::nullopt;
 
     // Get Content-Length
@@ -55,67 +58,15 @@ public:
     return content;
   }
 
-  void sendMessage(
-      const nlohmann::json &id,
-      const std::variant<lsp::Result, lsp::Error> &response) noexcept override {
-
-    auto res = generate_response(id, response);
-
-    {
-      std::lock_guard<std::mutex> lock(writeMutex);
-      std::cout << "Content-Length: " << res.contentLength << "\r\n\r\n";
-      std::cout << res.body;
-      std::cout.flush();
-    }
-  }
-
-  void sendNotification(const std::string &method,
-                        const nlohmann::ordered_json &params) override {
-
-    nlohmann::ordered_json message;
-    message["jsonrpc"] = "2.0";
-    message["method"] = method;
-
-    if (!params.is_null()) {
-      message["params"] = params;
-    }
-
-    const std::string body = message.dump();
-    {
-      std::lock_guard<std::mutex> lock(writeMutex);
-      std::cout << "Content-Length: " << body.size() << "\r\n\r\n";
-      std::cout << body;
-      std::cout.flush();
-    }
+protected:
+  void writeFrame(const std::string &body) noexcept override {
+    std::cout << "Content-Length: " << body.size() << "\r\n\r\n";
+    std::cout << body;
+    std::cout.flush();
   }
 
 private:
-  std::mutex writeMutex;
-
-  lsp::Response
-  generate_response(const nlohmann::json &id,
-                    const std::variant<lsp::Result, lsp::Error> &result) {
-
-    nlohmann::ordered_json msg;
-    msg["jsonrpc"] = "2.0";
-    msg["id"] = id;
-
-    if (std::holds_alternative<lsp::Result>(result)) {
-      nlohmann::ordered_json resultJson;
-      lsp::to_json(resultJson, std::get<lsp::Result>(result));
-      msg["result"] = resultJson;
-    } else {
-      nlohmann::ordered_json errorJson;
-      lsp::to_json(errorJson, std::get<lsp::Error>(result));
-      msg["error"] = errorJson;
-    }
-
-    std::string body = msg.dump();
-    int contentlength = static_cast<int>(body.size());
-    return {contentlength, body};
-  }
-
-  bool parse_header(std::map<std::string, std::string> &headers,
+  static bool parse_header(std::map<std::string, std::string> &headers,
                     const std::string &line) {
 
     auto pos = line.find(':');
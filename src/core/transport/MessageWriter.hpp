@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <variant>
+
+#include "core/interfaces/IMessage.hpp"
+#include "lsp/errors.hpp"
+#include "lsp/responses.hpp"
+#include <nlohmann/json.hpp>
+
+// Serializes responses, notifications and server requests into LSP frames.
+// Transports only provide writeFrame(), which is called under a lock so
+// frames from different threads never interleave.
+class MessageWriter : public IMessage {
+public:
+  void sendMessage(
+      const nlohmann::json &id,
+      const std::variant<lsp::Result, lsp::Error> &response) noexcept override {
+
+    auto res = generate_response(id, response);
+
+    {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      writeFrame(res.body);
+    }
+  }
+
+  void sendNotification(const std::string &method,
+                        const nlohmann::ordered_json &params) override {
+
+    nlohmann::ordered_json message;
+    message["jsonrpc"] = "2.0";
+    message["method"] = method;
+
+    if (!params.is_null()) {
+      message["params"] = params;
+    }
+
+    const std::string body = message.dump();
+    {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      writeFrame(body);
+    }
+  }
+
+  void sendRequest(const std::string &method,
+                   const nlohmann::ordered_json &params) override {
+
+    nlohmann::ordered_json message;
+    message["jsonrpc"] = "2.0";
+    message["id"] = "hack-ls-" + std::to_string(nextRequestId++);
+    message["method"] = method;
+    message["params"] = params;
+
+    const std::string body = message.dump();
+    {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      writeFrame(body);
+    }
+  }
+
+protected:
+  // Writes the Content-Length header and the body
+  virtual void writeFrame(const std::string &body) noexcept = 0;
+
+private:
+  std::mutex writeMutex;
+  std::atomic<int> nextRequestId = 1;
+
+  lsp::Response
+  generate_response(const nlohmann::json &id,
+                    const std::variant<lsp::Result, lsp::Error> &result) {
+
+    // Pre-serialized results are spliced straight into the body
+    if (std::holds_alternative<lsp::Result>(result) &&
+        std::holds_alternative<lsp::RawResult>(
+            std::get<lsp::Result>(result))) {
+      const auto &raw =
+          std::get<lsp::RawResult>(std::get<lsp::Result>(result)).json;
+
+      std::string body = R"({"jsonrpc":"2.0","id":)";
+      body.reserve(body.size() + raw.size() + 32);
+      body += id.dump();
+      body += R"(,"result":)";
+      body += raw;
+      body += '}';
+
+      int contentlength = static_cast<int>(body.size());
+      return {contentlength, std::move(body)};
+    }
+
+    nlohmann::ordered_json msg;
+    msg["jsonrpc"] = "2.0";
+    msg["id"] = id;
+
+    if (std::holds_alternative<lsp::Result>(result)) {
+      nlohmann::ordered_json resultJson;
+      lsp::to_json(resultJson, std::get<lsp::Result>(result));
+      msg["result"] = resultJson;
+    } else {
+      nlohmann::ordered_json errorJson;
+      lsp::to_json(errorJson, std::get<lsp::Error>(result));
+      msg["error"] = errorJson;
+    }
+
+    std::string body = msg.dump();
+    int contentlength = static_cast<int>(body.size());
+    return {contentlength, body};
+  }
+};
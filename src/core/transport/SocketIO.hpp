@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "core/transport/MessageWriter.hpp"
+
+// LSP over a connected, non-blocking socket. Frames are sent as far as the
+// socket takes them and the rest is queued; the queue is flushed when the
+// event loop reports the socket writable, so a stalled client never blocks
+// the loop or the other sessions. A client that lets more than
+// MAX_QUEUED_BYTES pile up is dropped.
+class SocketIO : public MessageWriter {
+public:
+  // epollFd is the loop's; EPOLLOUT is watched while frames are queued
+  SocketIO(int _fd, int _epollFd) : fd(_fd), epollFd(_epollFd) {}
+
+  // Set once a write failed; the session is closed after the current message
+  bool isBroken() const { return broken; }
+
+  // Called by the event loop on EPOLLOUT; false once the socket failed
+  bool flush() noexcept {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    sendQueued();
+    return !broken;
+  }
+
+protected:
+  void writeFrame(const std::string &body) noexcept override {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (broken)
+      return;
+
+    if (queued.size() + body.size() > MAX_QUEUED_BYTES) {
+      broken = true;
+      return;
+    }
+
+    queued += "Content-Length: ";
+    queued += std::to_string(body.size());
+    queued += "\r\n\r\n";
+    queued += body;
+    sendQueued();
+  }
+
+private:
+  // Responses a client has not read yet; far above any single response
+  static constexpr size_t MAX_QUEUED_BYTES = 256 * 1024 * 1024;
+
+  int fd;
+  int epollFd;
+  std::atomic<bool> broken = false; // also written by request workers
+
+  std::mutex queueMutex;
+  std::string queued; // guarded by queueMutex
+  size_t sent = 0;    // bytes of queued already written
+  bool watchingWritable = false;
+
+  void sendQueued() noexcept {
+    while (!broken && sent < queued.size()) {
+      // MSG_NOSIGNAL: a closed peer is an error here, not a SIGPIPE
+      ssize_t n = ::send(fd, queued.data() + sent, queued.size() - sent,
+                         MSG_NOSIGNAL);
+      if (n > 0) {
+        sent += static_cast<size_t>(n);
+        continue;
+      }
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        queued.erase(0, sent);
+        sent = 0;
+        watchWritable(true);
+        return;
+      }
+
+      broken = true;
+    }
+
+    queued.clear();
+    sent = 0;
+    watchWritable(false);
+  }
+
+  void watchWritable(bool watch) noexcept {
+    if (watch == watchingWritable)
+      return;
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP | (watch ? EPOLLOUT : 0);
+    event.data.fd = fd;
+    if (::epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) != 0)
+      broken = true;
+    watchingWritable = watch;
+  }
+};
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/structures/TextDocument.hpp"
+#include "hack/HackSyntax.hpp"
+
+// Maps source lines to ROM addresses. Lines are stored in chunks of about
+// CHUNK_LINES with a per-chunk instruction count; the first line and first
+// address of every chunk form a prefix sum that is rebuilt lazily from the
+// first chunk an edit touched. A lookup is a binary search over chunks plus
+// a count inside one chunk, and an edit only moves lines within the chunks
+// it touches. Line lengths in bytes are kept the same way, so an edit finds
+// the lines it added in the text without walking the lines before them.
+class AddressMap {
+public:
+  static constexpr size_t CHUNK_LINES = 256;
+
+  void build(std::string_view text) {
+    chunks.clear();
+    validChunks = 0;
+
+    hack::forEachLine(text, [&](int, std::string_view lineText) {
+      if (chunks.empty() || chunks.back().lines.size() == CHUNK_LINES)
+        chunks.emplace_back();
+
+      auto &chunk = chunks.back();
+      bool instruction = isInstruction(lineText);
+      uint32_t bytes = lineBytes(text, lineText);
+      chunk.lines.push_back(instruction);
+      chunk.bytes.push_back(bytes);
+      chunk.instructions += instruction;
+      chunk.byteCount += bytes;
+    });
+  }
+
+  // Applies the line splices of one change, then re-classifies the lines
+  // they added. Only those lines of the text are walked; if the stored
+  // lengths do not lead to a line start, the map is rebuilt from the text.
+  void update(std::string_view text, const std::vector<LineSplice> &splices) {
+    std::vector<std::pair<size_t, size_t>> added; // [start, end) in new lines
+
+    for (const auto &splice : splices) {
+      size_t start = splice.startLine;
+      size_t removedEnd = start + splice.removedLines;
+      auto moved = [&](size_t line) {
+        return line + splice.addedLines - splice.removedLines;
+      };
+
+      // Earlier additions after this splice move with it; the parts inside
+      // the removed range are gone
+      std::vector<std::pair<size_t, size_t>> kept;
+      for (const auto &range : added) {
+        if (range.second <= start) {
+          kept.push_back(range);
+          continue;
+        }
+        if (range.first < start)
+          kept.push_back({range.first, start});
+        if (range.second > removedEnd)
+          kept.push_back({moved(std::max(range.first, removedEnd)),
+                          moved(range.second)});
+      }
+      added = std::move(kept);
+
+      erase(start, splice.removedLines);
+      insert(start, splice.addedLines);
+      added.push_back({start, start + splice.addedLines});
+    }
+
+    // In line order, so the lengths before each range are already set
+    std::sort(added.begin(), added.end());
+    for (const auto &[first, end] : added) {
+      if (first == end)
+        continue;
+
+      size_t offset = byteOffset(first);
+      if (offset > text.size() || (offset > 0 && text[offset - 1] != '\n')) {
+        build(text);
+        return;
+      }
+
+      std::string_view rest = text.substr(offset);
+      hack::forEachLine(rest, [&](int i, std::string_view lineText) {
+        size_t line = first + static_cast<size_t>(i);
+        if (line >= end)
+          return false;
+        set(line, isInstruction(lineText), lineBytes(rest, lineText));
+        return true;
+      });
+    }
+  }
+
+  // ROM address of the instruction on line, or nullopt for lines that hold
+  // no instruction
+  std::optional<uint32_t> address(size_t line) {
+    std::optional<uint32_t> result;
+    forEachAddress(line, line, [&](size_t, uint32_t address) {
+      result = address;
+    });
+    return result;
+  }
+
+  // Calls fn(line, address) for every instruction in lines [first, last]
+  template <typename Fn> void forEachAddress(size_t first, size_t last, Fn fn) {
+    updatePrefix();
+    if (chunks.empty())
+      return;
+
+    size_t c = chunkOf(first);
+    if (c == chunks.size())
+      return;
+
+    uint32_t address = firstAddress[c];
+    size_t line = firstLine[c];
+
+    for (; c < chunks.size() && line <= last; c++) {
+      for (uint8_t instruction : chunks[c].lines) {
+        if (line > last)
+          return;
+        if (instruction && line >= first)
+          fn(line, address);
+        address += instruction;
+        line++;
+      }
+    }
+  }
+
+private:
+  struct Chunk {
+    std::vector<uint8_t> lines;  // 1 if the line holds an instruction
+    std::vector<uint32_t> bytes; // length of each line with its line break
+    uint32_t instructions = 0;
+    size_t byteCount = 0;
+  };
+
+  std::vector<Chunk> chunks;
+  std::vector<size_t> firstLine;
+  std::vector<uint32_t> firstAddress;
+  std::vector<size_t> firstByte;
+  size_t validChunks = 0; // prefix entries [0, validChunks) are current
+
+  static bool isInstruction(std::string_view lineText) {
+    std::string_view code = hack::stripComment(lineText);
+    size_t begin = code.find_first_not_of(" \t");
+    return begin != std::string_view::npos && code[begin] != '(';
+  }
+
+  // Length of lineText, a line forEachLine gave for text, with the line
+  // break it stripped
+  static uint32_t lineBytes(std::string_view text, std::string_view lineText) {
+    size_t start = static_cast<size_t>(lineText.data() - text.data());
+    size_t end = start + lineText.size();
+    if (end < text.size() && text[end] == '\r')
+      end++;
+    if (end < text.size() && text[end] == '\n')
+      end++;
+    return static_cast<uint32_t>(end - start);
+  }
+
+  void updatePrefix() {
+    firstLine.resize(chunks.size());
+    firstAddress.resize(chunks.size());
+    firstByte.resize(chunks.size());
+
+    for (size_t c = validChunks; c < chunks.size(); c++) {
+      firstLine[c] = c == 0 ? 0 : firstLine[c - 1] + chunks[c - 1].lines.size();
+      firstAddress[c] =
+          c == 0 ? 0 : firstAddress[c - 1] + chunks[c - 1].instructions;
+      firstByte[c] = c == 0 ? 0 : firstByte[c - 1] + chunks[c - 1].byteCount;
+    }
+    validChunks = chunks.size();
+  }
+
+  // Offset in the text of where line starts, from the stored lengths
+  size_t byteOffset(size_t line) {
+    auto [c, offset] = locate(line);
+    const auto &bytes = chunks[c].bytes;
+    size_t result = firstByte[c];
+    for (size_t i = 0; i < offset; i++)
+      result += bytes[i];
+    return result;
+  }
+
+  // Index of the chunk holding line; chunks.size() if past the end
+  size_t chunkOf(size_t line) {
+    auto it = std::upper_bound(firstLine.begin(), firstLine.end(), line);
+    size_t c = static_cast<size_t>(it - firstLine.begin()) - 1;
+    return line < firstLine[c] + chunks[c].lines.size() ? c : chunks.size();
+  }
+
+  // Chunk and offset where line starts, for edits. A line one past the end
+  // maps to the end of the last chunk.
+  std::pair<size_t, size_t> locate(size_t line) {
+    if (chunks.empty())
+      chunks.emplace_back();
+    updatePrefix();
+
+    size_t c = chunkOf(line);
+    if (c == chunks.size()) {
+      c = chunks.size() - 1;
+      return {c, chunks[c].lines.size()};
+    }
+    return {c, line - firstLine[c]};
+  }
+
+  void set(size_t line, bool instruction, uint32_t bytes) {
+    auto [c, offset] = locate(line);
+    if (offset >= chunks[c].lines.size())
+      return;
+
+    auto &chunk = chunks[c];
+    chunk.instructions += uint32_t(instruction) - chunk.lines[offset];
+    chunk.lines[offset] = instruction;
+    chunk.byteCount = chunk.byteCount - chunk.bytes[offset] + bytes;
+    chunk.bytes[offset] = bytes;
+    validChunks = std::min(validChunks, c + 1);
+  }
+
+  void erase(size_t line, size_t count) {
+    while (count > 0) {
+      auto [c, offset] = locate(line);
+      auto &chunk = chunks[c];
+      if (offset >= chunk.lines.size())
+        return;
+
+      size_t n = std::min(count, chunk.lines.size() - offset);
+      auto begin = chunk.lines.begin() + offset;
+      for (auto it = begin; it != begin + n; it++)
+        chunk.instructions -= *it;
+      chunk.lines.erase(begin, begin + n);
+
+      auto bytes = chunk.bytes.begin() + offset;
+      for (auto it = bytes; it != bytes + n; it++)
+        chunk.byteCount -= *it;
+      chunk.bytes.erase(bytes, bytes + n);
+      count -= n;
+
+      if (chunk.lines.empty() && chunks.size() > 1)
+        chunks.erase(chunks.begin() + c);
+      validChunks = std::min(validChunks, c);
+    }
+  }
+
+  // Inserts count empty non-instruction lines; update() classifies and
+  // measures them after
+  void insert(size_t line, size_t count) {
+    if (count == 0)
+      return;
+
+    auto [c, offset] = locate(line);
+    auto &chunk = chunks[c];
+    chunk.lines.insert(chunk.lines.begin() + offset, count, 0);
+    chunk.bytes.insert(chunk.bytes.begin() + offset, count, 0);
+    validChunks = std::min(validChunks, c);
+
+    // Split oversized chunks so edits stay local
+    if (chunk.lines.size() > 2 * CHUNK_LINES) {
+      std::vector<Chunk> pieces;
+      for (size_t i = 0; i < chunk.lines.size(); i += CHUNK_LINES) {
+        Chunk piece;
+        size_t end = std::min(chunk.lines.size(), i + CHUNK_LINES);
+        piece.lines.assign(chunk.lines.begin() + i, chunk.lines.begin() + end);
+        piece.bytes.assign(chunk.bytes.begin() + i, chunk.bytes.begin() + end);
+        for (uint8_t instruction : piece.lines)
+          piece.instructions += instruction;
+        for (uint32_t bytes : piece.bytes)
+          piece.byteCount += bytes;
+        pieces.push_back(std::move(piece));
+      }
+      chunks.erase(chunks.begin() + c);
+      chunks.insert(chunks.begin() + c, std::make_move_iterator(pieces.begin()),
+                    std::make_move_iterator(pieces.end()));
+    }
+  }
+};
+
+// AddressMap of every open document
+class AddressMaps {
+public:
+  void update(const std::string &uri, std::string_view text,
+              const std::vector<LineSplice> &splices) {
+    auto [it, inserted] = uriToMap.try_emplace(uri);
+    if (inserted)
+      it->second.build(text);
+    else
+      it->second.update(text, splices);
+  }
+
+  std::optional<uint32_t> address(const std::string &uri, size_t line) {
+    auto it = uriToMap.find(uri);
+    if (it == uriToMap.end())
+      return std::nullopt;
+    return it->second.address(line);
+  }
+
+  template <typename Fn>
+  void forEachAddress(const std::string &uri, size_t first, size_t last,
+                      Fn fn) {
+    auto it = uriToMap.find(uri);
+    if (it != uriToMap.end())
+      it->second.forEachAddress(first, last, fn);
+  }
+
+  void remove(const std::string &uri) { uriToMap.erase(uri); }
+
+private:
+  std::unordered_map<std::string, AddressMap> uriToMap;
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "core/handlers/DocumentsHandler.hpp"
+#include "core/interfaces/IMessage.hpp"
+#include "core/structures/TextDocument.hpp"
+#include "hack/HackAssembler.hpp"
+#include "hack/HackSyntax.hpp"
+#include "hack/InstructionTables.hpp"
+#include "hack/PredefinedSymbols.hpp"
+#include "lib/json_writer.hpp"
+#include "lsp/errors.hpp"
+#include "lsp/params.hpp"
+#include "lsp/responses.hpp"
+#include <nlohmann/json.hpp>
+
+// hack/assembledOutput: the machine code of a document, one word per ROM
+// address together with the source line it came from.
+//
+// Lines are encoded once and cached like semantic tokens: TextDocument
+// splices invalidate only the touched lines, so a request after an edit
+// re-encodes those lines and re-resolves symbolic A-instructions against
+// the current symbol table. Addresses are recounted on every request, which
+// is a walk over the cached lines.
+//
+// With a partialResultToken the words are streamed as $/progress chunks of
+// CHUNK_SIZE and the response itself is empty.
+//
+// program() is the same encoding without the serialization, for hack/run.
+class AssembledOutputEngine {
+public:
+  AssembledOutputEngine(DocumentsHandler &_documentsHandler,
+                        HackAssembler &_hackAssembler, IMessage &_io)
+      : documentsHandler(_documentsHandler), hackAssembler(_hackAssembler),
+        io(_io) {}
+
+  // Machine code of a document and the source line of every word
+  struct Program {
+    std::vector<uint16_t> words;
+    std::vector<uint32_t> lines;
+  };
+
+  // Encodes the document, failing with REQUEST_FAILED if it has errors
+  Program program(const std::string &uri) {
+    auto result = hackAssembler.getResult(uri);
+    if (result == nullptr) {
+      lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+      throw error;
+    }
+
+    if (result->diagnosticCount() > 0) {
+      lsp::Error error(lsp::ErrorCode::REQUEST_FAILED,
+                       "Document has errors and cannot be assembled");
+      throw error;
+    }
+
+    auto &lines = uriToLines[uri];
+    Program program;
+    int lineCount = 0;
+
+    auto document = documentsHandler.snapshot(uri);
+    hack::forEachLine(document->text, [&](int line, std::string_view lineText) {
+      lineCount = line + 1;
+      if (static_cast<size_t>(line) >= lines.size())
+        lines.emplace_back();
+
+      auto &cached = lines[line];
+      if (!cached.valid)
+        cached = encodeLine(line, lineText);
+
+      if (cached.kind == LineCode::None)
+        return;
+
+      uint16_t word = cached.word;
+      if (cached.kind == LineCode::Symbol)
+        word = resolve(cached.symbol, *result, line);
+
+      program.words.push_back(word);
+      program.lines.push_back(static_cast<uint32_t>(line));
+    });
+
+    if (lines.size() > static_cast<size_t>(lineCount))
+      lines.resize(lineCount);
+
+    return program;
+  }
+
+  lsp::RawResult output(lsp::AssembledOutputParams &params) {
+    auto [words, sourceLines] = program(params.textDocument.uri);
+
+    const bool hex = params.format == lsp::AssembledOutputFormat::Hex;
+
+    if (params.partialResultToken) {
+      for (size_t start = 0; start < words.size(); start += CHUNK_SIZE) {
+        size_t end = std::min(words.size(), start + CHUNK_SIZE);
+
+        nlohmann::ordered_json chunk;
+        chunk["start"] = start;
+        chunk["words"] = nlohmann::ordered_json::array();
+        chunk["lines"] = nlohmann::ordered_json::array();
+        for (size_t i = start; i < end; i++) {
+          chunk["words"].push_back(format(words[i], hex));
+          chunk["lines"].push_back(sourceLines[i]);
+        }
+
+        nlohmann::ordered_json progress;
+        progress["token"] = *params.partialResultToken;
+        progress["value"] = std::move(chunk);
+        io.sendNotification("$/progress", progress);
+      }
+
+      return serialize(hex, {}, {});
+    }
+
+    return serialize(hex, words, sourceLines);
+  }
+
+  void applySplices(const std::string &uri,
+                    const std::vector<LineSplice> &splices) {
+    auto it = uriToLines.find(uri);
+    if (it == uriToLines.end())
+      return;
+
+    auto &lines = it->second;
+    for (const auto &splice : splices) {
+      size_t start = std::min<size_t>(splice.startLine, lines.size());
+      size_t end = std::min<size_t>(start + splice.removedLines, lines.size());
+
+      lines.erase(lines.begin() + start, lines.begin() + end);
+      lines.insert(lines.begin() + start, splice.addedLines, LineCode{});
+    }
+  }
+
+  void remove(const std::string &uri) { uriToLines.erase(uri); }
+
+private:
+  static constexpr size_t CHUNK_SIZE = 4096;
+
+  struct LineCode {
+    enum Kind : uint8_t { None, Word, Symbol };
+
+    bool valid = false;
+    Kind kind = None;
+    uint16_t word = 0;
+    std::string symbol; // for symbolic A-instructions
+  };
+
+  DocumentsHandler &documentsHandler;
+  HackAssembler &hackAssembler;
+  IMessage &io;
+  std::unordered_map<std::string, std::vector<LineCode>> uriToLines;
+
+  static LineCode encodeLine(int line, std::string_view lineText) {
+    LineCode code;
+    code.valid = true;
+
+    std::string_view instruction = hack::stripComment(lineText);
+    size_t begin = instruction.find_first_not_of(" \t");
+    if (begin == std::string_view::npos || instruction[begin] == '(')
+      return code;
+
+    if (instruction[begin] == '@') {
+      size_t end = instruction.find_last_not_of(" \t") + 1;
+      std::string_view value = instruction.substr(begin + 1, end - begin - 1);
+
+      if (!value.empty() &&
+          std::isdigit(static_cast<unsigned char>(value[0]))) {
+        const char *last = value.data() + value.size();
+        unsigned constant = 0;
+        auto [ptr, ec] = std::from_chars(value.data(), last, constant);
+        if (ec != std::errc() || ptr != last || constant > 0x7FFF)
+          fail(line);
+
+        code.kind = LineCode::Word;
+        code.word = static_cast<uint16_t>(constant);
+      } else {
+        code.kind = LineCode::Symbol;
+        code.symbol = std::string(value);
+      }
+      return code;
+    }
+
+    auto parsed = hack::parseCInstruction(instruction);
+    auto word = parsed ? hack::encode(*parsed) : std::nullopt;
+    if (!word)
+      fail(line);
+
+    code.kind = LineCode::Word;
+    code.word = *word;
+    return code;
+  }
+
+  static uint16_t resolve(const std::string &name,
+                          const AssemblyResult &result, int line) {
+    if (auto predefined = hack::predefinedValue(name))
+      return static_cast<uint16_t>(*predefined);
+
+    auto value = result.value(name);
+    if (!value)
+      fail(line);
+    return static_cast<uint16_t>(*value);
+  }
+
+  [[noreturn]] static void fail(int line) {
+    lsp::Error error(lsp::ErrorCode::REQUEST_FAILED,
+                     "Cannot encode the instruction on line " +
+                         std::to_string(line + 1));
+    throw error;
+  }
+
+  static std::string format(uint16_t word, bool hex) {
+    static constexpr char DIGITS[] = "0123456789abcdef";
+    std::string out;
+
+    if (hex) {
+      for (int shift = 12; shift >= 0; shift -= 4)
+        out += DIGITS[(word >> shift) & 0xF];
+    } else {
+      for (int bit = 15; bit >= 0; bit--)
+        out += (word >> bit) & 1 ? '1' : '0';
+    }
+    return out;
+  }
+
+  static lsp::RawResult serialize(bool hex, const std::vector<uint16_t> &words,
+                                  const std::vector<uint32_t> &sourceLines) {
+    std::string json;
+    json.reserve(words.size() * (hex ? 14 : 26) + 48);
+
+    json += R"({"format":)";
+    json += hex ? R"("hex")" : R"("binary")";
+    json += R"(,"words":[)";
+    for (size_t i = 0; i < words.size(); i++) {
+      if (i > 0)
+        json += ',';
+      json += '"';
+      json += format(words[i], hex);
+      json += '"';
+    }
+    json += R"(],"lines":)";
+    json_writer::appendIntArray(json, sourceLines);
+    json += '}';
+
+    return lsp::RawResult{std::move(json)};
+  }
+};
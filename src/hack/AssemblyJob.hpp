@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "core/handlers/DocumentsHandler.hpp"
+#include "hack/AssemblyResult.hpp"
+#include "hack/HackSyntax.hpp"
+
+// Assembles one version of a large document without holding up the message
+// thread. The C assembler's assemble() runs to completion once called, so
+// the work cannot be cut into slices of the assembly itself; it runs on a
+// thread the job owns, and the message thread calls step() in short slices,
+// which scans the source for label declarations a chunk of lines at a time
+// and then waits for the result for whatever is left of the slice. Between
+// slices pending requests are answered, and completion offers the labels
+// found so far.
+//
+// A job dropped for a newer version is cancelled: the assembly is done in
+// ChunkedAssembler chunks on the job's thread and stops before the next
+// chunk, but the chunk under way runs to its end. Its owner waits for
+// finished() before starting another job for the document, so a document
+// has at most one assembly running.
+class AssemblyJob {
+public:
+  // Returns nullopt once cancelled is set
+  using Assemble = std::optional<AssemblyResult> (*)(
+      std::string_view source, uint64_t contentHash,
+      const std::atomic<bool> &cancelled);
+
+  AssemblyJob(DocumentSnapshot _document, uint64_t _contentHash,
+              Assemble _assemble)
+      : document(std::move(_document)), contentHash(_contentHash),
+        assemble(_assemble) {}
+
+  AssemblyJob(const AssemblyJob &) = delete;
+  AssemblyJob &operator=(const AssemblyJob &) = delete;
+
+  ~AssemblyJob() {
+    cancel();
+    if (worker.joinable())
+      worker.join();
+  }
+
+  // Starts the assembly; step() only scans until then
+  void start() {
+    if (worker.joinable())
+      return;
+
+    worker = std::thread([this] {
+      auto assembled = assemble(document->text, contentHash, cancelled);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      result = std::move(assembled);
+      finishedRunning = true;
+      done.notify_all();
+    });
+  }
+
+  void cancel() { cancelled = true; }
+
+  // True once the thread is done with the text, or if it never started
+  bool finished() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return finishedRunning || !worker.joinable();
+  }
+
+  // Works for at most budget; returns true once the result is ready
+  bool step(std::chrono::microseconds budget) {
+    auto deadline = std::chrono::steady_clock::now() + budget;
+
+    std::string_view text = document->text;
+    size_t found = labels.size();
+    while (scanned < text.size() && std::chrono::steady_clock::now() < deadline)
+      scanLines(text);
+
+    if (labels.size() != found)
+      published = std::make_shared<const std::vector<std::string>>(labels);
+
+    if (scanned < text.size() || !worker.joinable())
+      return false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    return done.wait_until(lock, deadline, [&] { return result.has_value(); });
+  }
+
+  // Only valid once step() returned true
+  AssemblyResult takeResult() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::move(*result);
+  }
+
+  uint64_t hash() const { return contentHash; }
+  std::string_view text() const { return document->text; }
+
+  // Labels declared in the part of the document scanned so far
+  std::shared_ptr<const std::vector<std::string>> partialLabels() const {
+    return published;
+  }
+
+private:
+  // Lines scanned between clock reads
+  static constexpr int LINES_PER_CHECK = 4096;
+
+  DocumentSnapshot document;
+  uint64_t contentHash;
+  Assemble assemble;
+
+  std::atomic<bool> cancelled = false;
+  std::mutex mutex;
+  std::condition_variable done;
+  std::optional<AssemblyResult> result; // guarded by mutex
+  bool finishedRunning = false;         // guarded by mutex
+  std::thread worker;
+
+  size_t scanned = 0; // byte offset of the next line
+  std::vector<std::string> labels;
+  std::shared_ptr<const std::vector<std::string>> published;
+
+  void scanLines(std::string_view text) {
+    for (int n = 0; n < LINES_PER_CHECK && scanned < text.size(); n++) {
+      size_t end = text.find('\n', scanned);
+      if (end == std::string_view::npos)
+        end = text.size();
+
+      std::string_view name =
+          hack::labelDeclaration(text.substr(scanned, end - scanned));
+      scanned = end + 1;
+
+      if (!name.empty())
+        labels.emplace_back(name);
+    }
+  }
+};
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hack/HackSyntax.hpp"
+#include "lib/MappedFile.hpp"
+#include "lib/hash.hpp"
+
+extern "C" {
+#include "assembler.h"
+#include "structures.h"
+#include "types.h"
+}
+
+// Flat encoding of the parts of an assembler result the server uses: the
+// user-defined symbols (labels map to their ROM address) and the
+// diagnostics. Entries written to the disk cache also carry the symbol
+// occurrences of their text, so a cached file is indexed without reading
+// it (see DocumentSymbols::fromResult). The same bytes are kept in memory
+// and written to the disk cache, so a cached result is used straight from
+// its mapping without being parsed.
+//
+//   Header      magic, content hash, symbol, diagnostic, slot and
+//               occurrence counts
+//   Symbols     { nameOffset, nameLength, value } * symbolCount
+//   Slots       symbol index + 1 (0 = empty) * slotCount, a linear-probing
+//               hash table over the names so lookups are O(1) even when
+//               the result is used straight from a mapping
+//   Diagnostics { line, messageOffset, messageLength } * diagnosticCount
+//   Occurrences { nameOffset, nameLength, line, start, end, declaration }
+//               * occurrenceCount
+//   Strings     names and messages, offsets are relative to this block
+class AssemblyResult {
+public:
+  struct Symbol {
+    std::string_view name;
+    int value;
+  };
+
+  struct Problem {
+    int line; // 1-based, as reported by the assembler
+    std::string_view message;
+  };
+
+  // A label declaration or @symbol reference, as SymbolOccurrence
+  struct Occurrence {
+    std::string_view name;
+    int line;
+    int start;
+    int end;
+    bool declaration;
+  };
+
+  // Copies a C result; the caller still owns and frees it
+  static AssemblyResult fromAssembler(const AssemblerResult &result,
+                                      uint64_t contentHash) {
+    int symbolCount = result.symbols ? result.symbols->size : 0;
+    int diagnosticCount = result.diagnostics ? result.diagnostics->size : 0;
+
+    // Predefined symbols are served from hack::PREDEFINED_SYMBOLS
+    std::vector<Symbol> symbols;
+    for (int i = 0; i < symbolCount; i++) {
+      const MapEntry &entry = result.symbols->data[i];
+      if (!hack::isPredefinedSymbol(entry.key))
+        symbols.push_back({entry.key, entry.value});
+    }
+
+    std::vector<Problem> problems;
+    problems.reserve(diagnosticCount);
+    for (int i = 0; i < diagnosticCount; i++) {
+      auto *diagnostic =
+          static_cast<Diagnostic *>(result.diagnostics->items[i]);
+      problems.push_back({diagnostic->line, diagnostic->message});
+    }
+
+    return fromParts(symbols, problems, contentHash);
+  }
+
+  // Encodes user-defined symbols and diagnostics collected elsewhere, e.g.
+  // merged from several assembler runs
+  static AssemblyResult
+  fromParts(const std::vector<Symbol> &symbols,
+            const std::vector<Problem> &problems, uint64_t contentHash,
+            const std::vector<Occurrence> &occurrences = {}) {
+    std::string strings;
+    std::string records;
+    records.reserve(symbols.size() * SYMBOL_SIZE +
+                    problems.size() * DIAGNOSTIC_SIZE +
+                    occurrences.size() * OCCURRENCE_SIZE);
+
+    for (const auto &symbol : symbols) {
+      appendString(records, strings, symbol.name);
+      append<int32_t>(records, symbol.value);
+    }
+
+    // At most half full, so probes stay short and always reach an empty slot
+    uint32_t slotCount = 1;
+    while (slotCount < symbols.size() * 2)
+      slotCount <<= 1;
+
+    std::vector<uint32_t> slots(slotCount, 0);
+    for (uint32_t i = 0; i < symbols.size(); i++) {
+      size_t slot = hash::hash64(symbols[i].name) & (slotCount - 1);
+      while (slots[slot] != 0)
+        slot = (slot + 1) & (slotCount - 1);
+      slots[slot] = i + 1;
+    }
+    for (uint32_t slot : slots)
+      append<uint32_t>(records, slot);
+
+    for (const auto &problem : problems) {
+      append<int32_t>(records, problem.line);
+      appendString(records, strings, problem.message);
+    }
+
+    for (const auto &occurrence : occurrences) {
+      appendString(records, strings, occurrence.name);
+      append<int32_t>(records, occurrence.line);
+      append<int32_t>(records, occurrence.start);
+      append<int32_t>(records, occurrence.end);
+      append<uint32_t>(records, occurrence.declaration);
+    }
+
+    AssemblyResult assembly;
+    std::string &bytes = assembly.owned;
+    bytes.reserve(HEADER_SIZE + records.size() + strings.size());
+
+    append<uint64_t>(bytes, MAGIC);
+    append<uint64_t>(bytes, contentHash);
+    append<uint32_t>(bytes, static_cast<uint32_t>(symbols.size()));
+    append<uint32_t>(bytes, static_cast<uint32_t>(problems.size()));
+    append<uint32_t>(bytes, slotCount);
+    append<uint32_t>(bytes, static_cast<uint32_t>(occurrences.size()));
+    bytes += records;
+    bytes += strings;
+
+    return assembly;
+  }
+
+  // Maps a cached result, rejecting files that are truncated, come from
+  // another format version or were written for different content
+  static std::optional<AssemblyResult> fromFile(const std::string &path,
+                                                uint64_t contentHash) {
+    auto file = std::make_unique<MappedFile>(path);
+    if (!file->isOpen())
+      return std::nullopt;
+
+    AssemblyResult assembly;
+    assembly.mapped = std::move(file);
+
+    if (!assembly.isValid(contentHash))
+      return std::nullopt;
+
+    return assembly;
+  }
+
+  // This result with the occurrences of its text, for the disk cache
+  AssemblyResult withOccurrences(
+      const std::vector<Occurrence> &occurrences) const {
+    std::vector<Symbol> symbols;
+    symbols.reserve(symbolCount());
+    for (size_t i = 0; i < symbolCount(); i++) {
+      symbols.push_back(symbol(i));
+    }
+
+    std::vector<Problem> problems;
+    problems.reserve(diagnosticCount());
+    for (size_t i = 0; i < diagnosticCount(); i++) {
+      problems.push_back(diagnostic(i));
+    }
+
+    return fromParts(symbols, problems, contentHash(), occurrences);
+  }
+
+  std::string_view bytes() const {
+    return mapped ? mapped->view() : std::string_view(owned);
+  }
+
+  uint64_t contentHash() const { return read<uint64_t>(8); }
+
+  size_t symbolCount() const { return read<uint32_t>(16); }
+  size_t diagnosticCount() const { return read<uint32_t>(20); }
+  size_t occurrenceCount() const { return read<uint32_t>(28); }
+
+  Symbol symbol(size_t i) const {
+    size_t offset = HEADER_SIZE + i * SYMBOL_SIZE;
+    return {string(offset), read<int32_t>(offset + 8)};
+  }
+
+  // Value of a user-defined symbol
+  std::optional<int> value(std::string_view name) const {
+    size_t mask = slotCount() - 1;
+    size_t slot = hash::hash64(name) & mask;
+
+    while (uint32_t index = read<uint32_t>(slotsOffset() + slot * 4)) {
+      auto symbol = this->symbol(index - 1);
+      if (symbol.name == name)
+        return symbol.value;
+      slot = (slot + 1) & mask;
+    }
+    return std::nullopt;
+  }
+
+  Problem diagnostic(size_t i) const {
+    size_t offset = diagnosticsOffset() + i * DIAGNOSTIC_SIZE;
+    return {read<int32_t>(offset), string(offset + 4)};
+  }
+
+  Occurrence occurrence(size_t i) const {
+    size_t offset = occurrencesOffset() + i * OCCURRENCE_SIZE;
+    return {string(offset), read<int32_t>(offset + 8),
+            read<int32_t>(offset + 12), read<int32_t>(offset + 16),
+            read<uint32_t>(offset + 20) != 0};
+  }
+
+  size_t memoryUsage() const { return sizeof(*this) + bytes().size(); }
+
+private:
+  static constexpr uint64_t MAGIC = 0x34305352534C4B48; // "HKLSRS04"
+  static constexpr size_t HEADER_SIZE = 32;
+  static constexpr size_t SYMBOL_SIZE = 12;
+  static constexpr size_t DIAGNOSTIC_SIZE = 12;
+  static constexpr size_t OCCURRENCE_SIZE = 24;
+
+  std::string owned;
+  std::unique_ptr<MappedFile> mapped;
+
+  AssemblyResult() = default;
+
+  template <typename T> static void append(std::string &out, T value) {
+    char raw[sizeof(T)];
+    std::memcpy(raw, &value, sizeof(T));
+    out.append(raw, sizeof(T));
+  }
+
+  static void appendString(std::string &records, std::string &strings,
+                           std::string_view value) {
+    append<uint32_t>(records, static_cast<uint32_t>(strings.size()));
+    append<uint32_t>(records, static_cast<uint32_t>(value.size()));
+    strings.append(value);
+  }
+
+  template <typename T> T read(size_t offset) const {
+    T value;
+    std::memcpy(&value, bytes().data() + offset, sizeof(T));
+    return value;
+  }
+
+  size_t slotCount() const { return read<uint32_t>(24); }
+
+  size_t slotsOffset() const {
+    return HEADER_SIZE + symbolCount() * SYMBOL_SIZE;
+  }
+
+  size_t diagnosticsOffset() const { return slotsOffset() + slotCount() * 4; }
+
+  size_t occurrencesOffset() const {
+    return diagnosticsOffset() + diagnosticCount() * DIAGNOSTIC_SIZE;
+  }
+
+  size_t stringsOffset() const {
+    return occurrencesOffset() + occurrenceCount() * OCCURRENCE_SIZE;
+  }
+
+  // Reads a { offset, length } pair at the given record offset
+  std::string_view string(size_t offset) const {
+    return bytes().substr(stringsOffset() + read<uint32_t>(offset),
+                          read<uint32_t>(offset + 4));
+  }
+
+  bool isValid(uint64_t contentHash) const {
+    std::string_view data = bytes();
+    if (data.size() < HEADER_SIZE || read<uint64_t>(0) != MAGIC ||
+        this->contentHash() != contentHash)
+      return false;
+
+    // Counts are checked before any record is touched; the table must be a
+    // power of two with an empty slot so probing terminates
+    uint64_t slots = slotCount();
+    if (slots == 0 || (slots & (slots - 1)) != 0 || slots <= symbolCount())
+      return false;
+
+    uint64_t recordsEnd = HEADER_SIZE + uint64_t(symbolCount()) * SYMBOL_SIZE +
+                          slots * 4 +
+                          uint64_t(diagnosticCount()) * DIAGNOSTIC_SIZE +
+                          uint64_t(occurrenceCount()) * OCCURRENCE_SIZE;
+    if (recordsEnd > data.size())
+      return false;
+
+    uint64_t stringsSize = data.size() - recordsEnd;
+    auto inBounds = [&](size_t offset) {
+      return uint64_t(read<uint32_t>(offset)) + read<uint32_t>(offset + 4) <=
+             stringsSize;
+    };
+
+    for (size_t i = 0; i < symbolCount(); i++) {
+      if (!inBounds(HEADER_SIZE + i * SYMBOL_SIZE))
+        return false;
+    }
+    bool hasEmptySlot = false;
+    for (size_t i = 0; i < slots; i++) {
+      uint32_t index = read<uint32_t>(slotsOffset() + i * 4);
+      if (index > symbolCount())
+        return false;
+      hasEmptySlot |= index == 0;
+    }
+    if (!hasEmptySlot)
+      return false;
+    for (size_t i = 0; i < diagnosticCount(); i++) {
+      if (!inBounds(diagnosticsOffset() + i * DIAGNOSTIC_SIZE + 4))
+        return false;
+    }
+    for (size_t i = 0; i < occurrenceCount(); i++) {
+      if (!inBounds(occurrencesOffset() + i * OCCURRENCE_SIZE))
+        return false;
+    }
+    return true;
+  }
+};
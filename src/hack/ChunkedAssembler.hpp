@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hack/AssemblyResult.hpp"
+#include "hack/HackSyntax.hpp"
+
+extern "C" {
+#include "assembler.h"
+#include "structures.h"
+#include "types.h"
+}
+
+// Assembles a large text as line-aligned chunks on up to threads threads and
+// merges the chunk results into what a single assemble() of the whole text
+// gives.
+// Hack lines are independent except through symbols, so only the symbols
+// need fixing up:
+//
+//   Labels     a chunk's ROM addresses start at 0; the instruction counts
+//              of the chunks before it are added. Each chunk ends with a
+//              sentinel label whose address is the chunk's own count, so
+//              the assembler's counting is used rather than a second one.
+//   Variables  every chunk allocates from 16 in order of first use; they
+//              are renumbered in that order across chunks, skipping names
+//              that turn out to be labels declared in another chunk.
+//   Lines      diagnostics are moved down by the lines before the chunk.
+//
+// A label declared in two chunks would be reported by neither, so such
+// texts return nullopt and are assembled in one piece. So are texts shorter
+// than two chunks, and texts whose assembly was cancelled: the flag is read
+// before each chunk, as an assemble() call cannot be stopped part way.
+class ChunkedAssembler {
+public:
+  // Smaller chunks cost more in copying and merging than they save
+  static constexpr size_t CHUNK_BYTES = 256 * 1024;
+
+  static std::optional<AssemblyResult>
+  assemble(std::string_view source, uint64_t contentHash, unsigned threads,
+           const std::atomic<bool> *cancelled = nullptr,
+           size_t chunkBytes = CHUNK_BYTES) {
+    size_t chunkCount = source.size() / chunkBytes;
+    if (chunkCount < 2 || source.find(END_LABEL) != std::string_view::npos)
+      return std::nullopt;
+
+    std::vector<Chunk> chunks(chunkCount);
+    size_t start = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+      size_t end = source.size();
+      if (i + 1 < chunkCount) {
+        end = source.find('\n', std::max(start, source.size() * (i + 1) /
+                                                    chunkCount));
+        end = end == std::string_view::npos ? source.size() : end + 1;
+      }
+
+      chunks[i].text = source.substr(start, end - start);
+      start = end;
+    }
+
+    // Each thread, the calling one included, takes the next chunk left
+    std::atomic<size_t> next = 0;
+    auto work = [&] {
+      for (size_t i = next++; i < chunkCount; i = next++) {
+        if (cancelled && cancelled->load())
+          return;
+        chunks[i].assemble();
+      }
+    };
+
+    size_t helpers = std::min<size_t>(std::max(threads, 1u), chunkCount) - 1;
+    std::vector<std::thread> workers;
+    workers.reserve(helpers);
+    for (size_t i = 0; i < helpers; i++) {
+      workers.emplace_back(work);
+    }
+    work();
+
+    for (auto &thread : workers) {
+      thread.join();
+    }
+
+    if (cancelled && cancelled->load())
+      return std::nullopt;
+    return merge(chunks, contentHash);
+  }
+
+private:
+  // Cannot clash with a user label, as the source is checked for it
+  static constexpr std::string_view END_LABEL = "$hack_ls$chunk_end";
+
+  struct Chunk {
+    std::string_view text;
+    int lineCount = 0;
+    std::vector<std::string_view> labels; // declared in text, in order
+    AssemblerResult result{};
+    bool assembled = false;
+
+    Chunk() = default;
+    Chunk(const Chunk &) = delete;
+    Chunk &operator=(const Chunk &) = delete;
+
+    ~Chunk() {
+      if (assembled)
+        AssemblerResult__free(&result, CONFIG);
+    }
+
+    void assemble() {
+      std::string source(text);
+      if (!source.empty() && source.back() != '\n')
+        source += '\n';
+      lineCount = static_cast<int>(std::count(source.begin(), source.end(),
+                                              '\n'));
+
+      source += '(';
+      source += END_LABEL;
+      source += ")\n";
+
+      result = ::assemble(source.data(), CONFIG);
+      assembled = true;
+
+      hack::forEachLine(text, [&](int, std::string_view line) {
+        std::string_view name = hack::labelDeclaration(line);
+        if (!name.empty())
+          labels.push_back(name);
+      });
+    }
+
+    std::unordered_map<std::string_view, int> symbols() const {
+      std::unordered_map<std::string_view, int> values;
+      int count = result.symbols ? result.symbols->size : 0;
+      for (int i = 0; i < count; i++) {
+        values.emplace(result.symbols->data[i].key,
+                       result.symbols->data[i].value);
+      }
+      return values;
+    }
+  };
+
+  static constexpr AssemblerConfig CONFIG = {0, 0};
+
+  // RAM address of the first variable, after R0-R15
+  static constexpr int FIRST_VARIABLE = 16;
+
+  static std::optional<AssemblyResult>
+  merge(const std::vector<Chunk> &chunks, uint64_t contentHash) {
+    std::vector<std::unordered_map<std::string_view, int>> local;
+    local.reserve(chunks.size());
+    for (const auto &chunk : chunks) {
+      local.push_back(chunk.symbols());
+    }
+
+    // Labels first, as any chunk may use a label declared in a later one
+    std::vector<AssemblyResult::Symbol> symbols;
+    std::unordered_map<std::string_view, size_t> labels; // declaring chunk
+    int base = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+      auto end = local[i].find(END_LABEL);
+      if (end == local[i].end())
+        return std::nullopt;
+
+      for (std::string_view name : chunks[i].labels) {
+        auto value = local[i].find(name);
+        if (value == local[i].end())
+          continue;
+
+        auto [it, inserted] = labels.emplace(name, i);
+        if (inserted)
+          symbols.push_back({name, base + value->second});
+        else if (it->second != i)
+          return std::nullopt;
+      }
+      base += end->second;
+    }
+
+    // Each chunk numbered its variables in order of first use
+    std::unordered_map<std::string_view, int> variables;
+    int next = FIRST_VARIABLE;
+    for (const auto &values : local) {
+      std::vector<std::pair<int, std::string_view>> used;
+      for (const auto &[name, value] : values) {
+        if (name != END_LABEL && !labels.contains(name) &&
+            !hack::isPredefinedSymbol(name))
+          used.push_back({value, name});
+      }
+      std::sort(used.begin(), used.end());
+
+      for (const auto &[value, name] : used) {
+        if (variables.emplace(name, next).second) {
+          symbols.push_back({name, next});
+          next++;
+        }
+      }
+    }
+
+    // Diagnostics on the sentinel line belong to no source line
+    std::vector<AssemblyResult::Problem> problems;
+    int lines = 0;
+    for (const auto &chunk : chunks) {
+      int count = chunk.result.diagnostics ? chunk.result.diagnostics->size : 0;
+      for (int i = 0; i < count; i++) {
+        auto *diagnostic =
+            static_cast<Diagnostic *>(chunk.result.diagnostics->items[i]);
+        if (diagnostic->line <= chunk.lineCount)
+          problems.push_back({diagnostic->line + lines, diagnostic->message});
+      }
+      lines += chunk.lineCount;
+    }
+
+    return AssemblyResult::fromParts(symbols, problems, contentHash);
+  }
+};
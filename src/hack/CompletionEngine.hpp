@@ -1,24 +1,55 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "hack/HackAssembler.hpp"
+#include "hack/InstructionTables.hpp"
+#include "hack/PredefinedSymbols.hpp"
 #include "lsp/params.hpp"
 #include "lsp/protocol.hpp"
 #include "lsp/responses.hpp"
 
+// Like hovers, completions run on the request workers: prepare() takes the
+// document's current result on the message thread and the job builds the
+// items from it. While a large document is still being assembled, the
+// labels its AssemblyJob has found so far are offered too.
 class CompletionEngine {
 
 public:
+  using Job = std::function<lsp::CompletionResult()>;
+
   CompletionEngine(HackAssembler &_hackAssembler)
       : hackAssembler(_hackAssembler) {}
 
-  lsp::CompletionResult completion(lsp::CompletionParams &params) {
+  Job prepare(const lsp::CompletionParams &params) {
+    const std::string &uri = params.textDocument.uri;
+
+    Symbols symbols{hackAssembler.getResult(uri),
+                    hackAssembler.partialLabels(uri)};
+    return [symbols = std::move(symbols), params] {
+      return completion(params, symbols);
+    };
+  }
+
+private:
+  // A document's symbols as of prepare()
+  struct Symbols {
+    std::shared_ptr<const AssemblyResult> result;
+    std::shared_ptr<const std::vector<std::string>> partialLabels;
+  };
+
+  HackAssembler &hackAssembler;
+
+  static lsp::CompletionResult completion(const lsp::CompletionParams &params,
+                                          const Symbols &symbols) {
 
     // No context or no trigger character - send all completions
     if (!params.context || !params.context->triggerCharacter) {
-      return getAllCompletions(params.textDocument.uri);
+      return getAllCompletions(symbols);
     }
 
     const std::string &triggerChar = params.context->triggerCharacter.value();
@@ -26,64 +57,90 @@ public:
     // @ triggers symbol completions
     if (triggerChar ==
         protocol::serverDetails::COMPLETION_TRIGGER_CHARACTERS[0]) {
-      std::vector<std::string> symbols;
-      auto _symbols = hackAssembler.getSymbols(params.textDocument.uri);
-      if (_symbols != nullptr) {
-        for (int i = 0; i < _symbols->size; i++) {
-          symbols.push_back(_symbols->data[i].key);
-        }
-      }
-      return buildCompletions(symbols);
+      std::vector<std::string> list;
+      addSymbols(symbols, list);
+      return buildCompletions(list);
     }
 
     // = triggers comp completions
     if (triggerChar ==
         protocol::serverDetails::COMPLETION_TRIGGER_CHARACTERS[1]) {
-      auto allComps = hackAssembler.getComps();
-      return buildCompletions(allComps);
+      return buildCompletions(names(hack::COMPS));
     }
 
     // ; triggers jump completions
     if (triggerChar ==
         protocol::serverDetails::COMPLETION_TRIGGER_CHARACTERS[2]) {
-      auto allJumps = hackAssembler.getJumps();
-      return buildCompletions(allJumps);
+      return buildCompletions(names(hack::JUMPS));
     }
 
     // Unknown trigger character - send all
-    return getAllCompletions(params.textDocument.uri);
+    return getAllCompletions(symbols);
   }
 
-private:
-  HackAssembler &hackAssembler;
-
-  lsp::CompletionResult getAllCompletions(const std::string &uri) {
+  static lsp::CompletionResult getAllCompletions(const Symbols &symbols) {
     std::vector<std::string> all;
 
     // Add symbols
-    auto _symbols = hackAssembler.getSymbols(uri);
-    if (_symbols != nullptr) {
-      for (int i = 0; i < _symbols->size; i++) {
-        all.push_back(_symbols->data[i].key);
-      }
-    }
+    addSymbols(symbols, all);
 
     // Add dests
-    auto dests = hackAssembler.getDests();
+    auto dests = names(hack::DESTS);
     all.insert(all.end(), dests.begin(), dests.end());
 
     // Add comps
-    auto comps = hackAssembler.getComps();
+    auto comps = names(hack::COMPS);
     all.insert(all.end(), comps.begin(), comps.end());
 
     // Add jumps
-    auto jumps = hackAssembler.getJumps();
+    auto jumps = names(hack::JUMPS);
     all.insert(all.end(), jumps.begin(), jumps.end());
 
     return buildCompletions(all);
   }
 
-  lsp::CompletionResult buildCompletions(const std::vector<std::string> &list) {
+  // Predefined symbols first, then the document's labels and variables
+  static void addSymbols(const Symbols &symbols,
+                         std::vector<std::string> &out) {
+    for (const auto &symbol : hack::PREDEFINED_SYMBOLS) {
+      out.emplace_back(symbol.name);
+    }
+
+    const auto &result = symbols.result;
+    if (result != nullptr) {
+      for (size_t i = 0; i < result->symbolCount(); i++) {
+        out.emplace_back(result->symbol(i).name);
+      }
+    }
+
+    // The previous result may already hold labels the job found again
+    if (symbols.partialLabels != nullptr) {
+      std::unordered_set<std::string_view> seen;
+      if (result != nullptr) {
+        for (size_t i = 0; i < result->symbolCount(); i++) {
+          seen.insert(result->symbol(i).name);
+        }
+      }
+
+      for (const auto &label : *symbols.partialLabels) {
+        if (seen.insert(label).second)
+          out.push_back(label);
+      }
+    }
+  }
+
+  template <typename Table>
+  static std::vector<std::string> names(const Table &table) {
+    std::vector<std::string> list;
+    list.reserve(table.all().size());
+    for (const auto &mnemonic : table.all()) {
+      list.emplace_back(mnemonic.name);
+    }
+    return list;
+  }
+
+  static lsp::CompletionResult
+  buildCompletions(const std::vector<std::string> &list) {
     if (list.empty()) {
       return nullptr;
     }
@@ -1,111 +1,160 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "core/handlers/DocumentsHandler.hpp"
 #include "core/interfaces/IMessage.hpp"
 #include "hack/HackAssembler.hpp"
+#include "hack/HackSyntax.hpp"
+#include "hack/InstructionTables.hpp"
+#include "lib/hash.hpp"
 #include "lsp/messages.hpp"
+#include "lsp/params.hpp"
+#include "lsp/responses.hpp"
 #include <nlohmann/json.hpp>
 
-extern "C" {
-#include "structures.h"
-#include "types.h"
-}
-
-using DiagnosticsMessagesMap =
-    std::unordered_map<std::string, std::vector<lsp::DiagnosticMessage>>;
 
 class DiagnosticsEngine {
 public:
-  DiagnosticsEngine(HackAssembler &_hackAssembler, IMessage &_io)
-      : hackAssembler(_hackAssembler), io(_io) {};
+  DiagnosticsEngine(HackAssembler &_hackAssembler,
+                    DocumentsHandler &_documentsHandler, IMessage &_io)
+      : hackAssembler(_hackAssembler), documentsHandler(_documentsHandler),
+        io(_io) {};
 
-  void report() {
-    DiagnosticsMessagesMap uriToDiagnosticMessages;
-    buildDiagnostics(uriToDiagnosticMessages);
+  // Publishes the diagnostics of a single document
+  void report(const std::string &uri) {
+    auto result = hackAssembler.getResult(uri);
+    if (result == nullptr)
+      return;
 
-    for (const auto &entry : uriToDiagnosticMessages) {
-      publishDiagnostics(entry.first, entry.second);
-    }
+    publishDiagnostics(uri, buildDiagnostics(uri, *result));
   }
 
-private:
-  HackAssembler &hackAssembler;
-  IMessage &io;
-  std::unordered_map<std::string, std::vector<lsp::DiagnosticMessage>>
-      lastPublishedByUri;
+  void remove(const std::string &uri) { lastPublishedByUri.erase(uri); }
 
-  void buildDiagnostics(DiagnosticsMessagesMap &uriToDiagnosticMessages) {
+  // textDocument/diagnostic (pull model)
+  lsp::RawResult documentDiagnostic(lsp::DocumentDiagnosticParams &params) {
+    const std::string &uri = params.textDocument.uri;
 
-    const auto &uriToDiagnosticsVector = hackAssembler.getAllDiagnostics();
+    auto document = documentsHandler.find(uri);
+    if (document == nullptr) {
+      lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+      throw error;
+    }
 
-    for (const auto &entry : uriToDiagnosticsVector) {
+    auto report = buildReport(uri, *document, params.previousResultId);
+    return lsp::RawResult{report.dump()};
+  }
 
-      const std::string &uri = entry.first;
-      Vector *diagnosticVector = entry.second;
+  // workspace/diagnostic: one report per open document. Clients ask again
+  // as soon as they are answered, so a request whose reports would all be
+  // unchanged is held, and answered once a document's diagnostics change
+  // (see refresh()). Returns nullopt for a held request.
+  std::optional<lsp::RawResult>
+  workspaceDiagnostic(const nlohmann::json &id,
+                      lsp::WorkspaceDiagnosticParams &params) {
+    answerHeld(); // the client moved on to this request
 
-      std::vector<lsp::DiagnosticMessage> diagnostics;
-      diagnostics.reserve(diagnosticVector->size);
+    bool changed = false;
+    auto report = workspaceReport(params.previousResultIds, changed);
+    if (changed)
+      return report;
 
-      for (int i = 0; i < diagnosticVector->size; i++) {
-        auto *diagnostic =
-            static_cast<Diagnostic *>(diagnosticVector->items[i]);
+    held = HeldRequest{id, std::move(params.previousResultIds)};
+    return std::nullopt;
+  }
 
-        lsp::DiagnosticMessage message;
-        message.line = std::max(diagnostic->line - 1, 0);
-        message.character = 0;
-        message.message = diagnostic->message;
-        message.severity = lsp::Severity::Error;
-        diagnostics.push_back(std::move(message));
-      }
+  // Called once uri's result is rebuilt; answers the held request if the
+  // client's report for uri is no longer current
+  void refresh(const std::string &uri) {
+    auto document = documentsHandler.find(uri);
+    if (!held || document == nullptr)
+      return;
 
-      // Sort diagnostics by line number, then by character position
-      std::sort(diagnostics.begin(), diagnostics.end(),
-                [](const lsp::DiagnosticMessage &lhs,
-                   const lsp::DiagnosticMessage &rhs) {
-                  if (lhs.line == rhs.line) {
-                    return lhs.character < rhs.character;
-                  }
-                  return lhs.line < rhs.line;
-                });
-
-      uriToDiagnosticMessages[uri] = std::move(diagnostics);
-    }
+    auto previous = held->previousResultIds.find(uri);
+    if (previous != held->previousResultIds.end() &&
+        isCurrent(previous->second, document->text))
+      return;
+
+    answerHeld();
   }
 
-  void
-  publishDiagnostics(const std::string &uri,
-                     const std::vector<lsp::DiagnosticMessage> &diagnostics) {
-    // Skip sending if identical to last published for this URI
-    auto sameAsLast = [&]() -> bool {
-      auto it = lastPublishedByUri.find(uri);
-      if (it == lastPublishedByUri.end()) {
-        return false;
-      }
-      const auto &prev = it->second;
-      if (prev.size() != diagnostics.size()) {
-        return false;
-      }
-      for (size_t i = 0; i < diagnostics.size(); ++i) {
-        const auto &a = prev[i];
-        const auto &b = diagnostics[i];
-        if (a.line != b.line || a.character != b.character ||
-            a.message != b.message || a.severity != b.severity) {
-          return false;
-        }
-      }
-      return true;
-    }();
+  // Answers the held request with the reports as they are, e.g. on shutdown
+  void answerHeld() {
+    if (!held)
+      return;
 
-    if (sameAsLast) {
+    bool changed = false;
+    auto report = workspaceReport(held->previousResultIds, changed);
+    io.sendMessage(held->id, lsp::Result(std::move(report)));
+    held.reset();
+  }
+
+  // $/cancelRequest; only a held request is still unanswered
+  void cancel(const nlohmann::json &id) {
+    if (!held || held->id != id)
       return;
+
+    io.sendMessage(held->id, lsp::Error(lsp::ErrorCode::REQUEST_CANCELLED,
+                                        "Request cancelled"));
+    held.reset();
+  }
+
+  // Diagnostics of a result for the text it was assembled from; shared with
+  // the --check command line mode
+  static std::vector<lsp::DiagnosticMessage>
+  buildDiagnostics(std::string_view text, const AssemblyResult &result) {
+
+    std::vector<lsp::DiagnosticMessage> diagnostics;
+    diagnostics.reserve(result.diagnosticCount());
+    if (result.diagnosticCount() == 0)
+      return diagnostics;
+
+    // The assembler reports lines only; the span is the instruction on that
+    // line, so squiggles sit under the code and not under indentation or a
+    // trailing comment
+    std::vector<std::string_view> lines;
+    hack::forEachLine(text, [&](int, std::string_view lineText) {
+      lines.push_back(lineText);
+    });
+
+    for (size_t i = 0; i < result.diagnosticCount(); i++) {
+      auto diagnostic = result.diagnostic(i);
+
+      lsp::DiagnosticMessage message;
+      message.line = std::max(diagnostic.line - 1, 0);
+      if (static_cast<size_t>(message.line) < lines.size()) {
+        auto [start, end] = instructionSpan(lines[message.line]);
+        message.character = start;
+        message.endCharacter = end;
+      }
+      message.message = diagnostic.message;
+      message.severity = lsp::Severity::Error;
+      diagnostics.push_back(std::move(message));
     }
 
-    nlohmann::ordered_json params;
-    params["uri"] = uri;
+    // Sort diagnostics by line number, then by character position
+    std::sort(diagnostics.begin(), diagnostics.end(),
+              [](const lsp::DiagnosticMessage &lhs,
+                 const lsp::DiagnosticMessage &rhs) {
+                if (lhs.line == rhs.line) {
+                  return lhs.character < rhs.character;
+                }
+                return lhs.line < rhs.line;
+              });
+
+    return diagnostics;
+  }
+
+  static nlohmann::ordered_json
+  toJson(const std::vector<lsp::DiagnosticMessage> &diagnostics) {
 
     auto diagnosticsArray = nlohmann::ordered_json::array();
 
@@ -116,7 +165,8 @@ private:
           {"start",
            {{"line", diagnostic.line}, {"character", diagnostic.character}}},
           {"end",
-           {{"line", diagnostic.line}, {"character", diagnostic.character}}}};
+           {{"line", diagnostic.line},
+            {"character", diagnostic.endCharacter}}}};
 
       diagnosticJson["severity"] = static_cast<int>(diagnostic.severity);
       diagnosticJson["source"] = "hack-assembler";
@@ -125,9 +175,156 @@ private:
       diagnosticsArray.push_back(std::move(diagnosticJson));
     }
 
-    params["diagnostics"] = std::move(diagnosticsArray);
+    return diagnosticsArray;
+  }
+
+private:
+  HackAssembler &hackAssembler;
+  DocumentsHandler &documentsHandler;
+  IMessage &io;
+  // Digest of the last published diagnostics per URI
+  std::unordered_map<std::string, uint64_t> lastPublishedByUri;
+
+  struct HeldRequest {
+    nlohmann::json id;
+    std::unordered_map<std::string, std::string> previousResultIds;
+  };
+  std::optional<HeldRequest> held; // a workspace/diagnostic not yet answered
+
+  lsp::RawResult workspaceReport(
+      const std::unordered_map<std::string, std::string> &previousResultIds,
+      bool &changed) {
+    auto items = nlohmann::ordered_json::array();
+
+    for (const auto &document : documentsHandler.snapshots()) {
+      const std::string &uri = document->uri;
+
+      std::optional<std::string> previousResultId;
+      auto previous = previousResultIds.find(uri);
+      if (previous != previousResultIds.end())
+        previousResultId = previous->second;
+
+      nlohmann::ordered_json item;
+      item["uri"] = uri;
+      item["version"] = document->version;
+      item.update(buildReport(uri, *document, previousResultId));
+      changed |= item["kind"] == "full";
+      items.push_back(std::move(item));
+    }
+
+    nlohmann::ordered_json report;
+    report["items"] = std::move(items);
+    return lsp::RawResult{report.dump()};
+  }
+
+  static bool isCurrent(std::string_view resultId, std::string_view text) {
+    return resultId.ends_with(":" + hash::toHex(hash::hash64(text)));
+  }
+
+  // The result id is "<version>:<content hash>". Diagnostics depend only on
+  // the text, so a matching hash means the client's copy is still current
+  // even if the version moved (e.g. after an undo). A document whose first
+  // assembly is still running reports no diagnostics as "<version>:pending",
+  // which is not current once its result is in.
+  nlohmann::ordered_json
+  buildReport(const std::string &uri, const TextDocument &document,
+              const std::optional<std::string> &previousResultId) {
+
+    std::string contentHash = hash::toHex(hash::hash64(document.text));
+    std::string resultId = std::to_string(document.version) + ":" + contentHash;
+
+    nlohmann::ordered_json report;
+
+    if (previousResultId && previousResultId->ends_with(":" + contentHash)) {
+      report["kind"] = "unchanged";
+      report["resultId"] = resultId;
+      return report;
+    }
+
+    auto result = hackAssembler.getResult(uri);
+    if (result == nullptr)
+      resultId = std::to_string(document.version) + ":pending";
+
+    if (previousResultId == resultId) {
+      report["kind"] = "unchanged";
+      report["resultId"] = resultId;
+      return report;
+    }
+
+    report["kind"] = "full";
+    report["resultId"] = resultId;
+    report["items"] = result ? toJson(buildDiagnostics(uri, *result))
+                             : nlohmann::ordered_json::array();
+    return report;
+  }
+
+  std::vector<lsp::DiagnosticMessage>
+  buildDiagnostics(const std::string &uri, const AssemblyResult &result) {
+    return buildDiagnostics(
+        std::string_view(documentsHandler.snapshot(uri)->text), result);
+  }
+
+  // UTF-16 columns of the code on a line, excluding surrounding whitespace
+  // and comments. For C-instructions the span narrows to the first field
+  // the mnemonic tables reject.
+  static std::pair<int, int> instructionSpan(std::string_view lineText) {
+    std::string_view code = hack::stripComment(lineText);
+
+    size_t begin = code.find_first_not_of(" \t");
+    if (begin == std::string_view::npos)
+      return {0, 0};
+    size_t end = code.find_last_not_of(" \t") + 1;
+
+    if (auto instruction = hack::parseCInstruction(code)) {
+      auto field = [&](std::string_view text, size_t start) {
+        return std::pair<int, int>{
+            hack::utf16Column(lineText, start),
+            hack::utf16Column(lineText, start + text.size())};
+      };
+
+      if (!hack::isValidDest(instruction->dest))
+        return field(instruction->dest, instruction->destStart);
+      if (!instruction->comp.empty() && !hack::isValidComp(instruction->comp))
+        return field(instruction->comp, instruction->compStart);
+      if (!hack::isValidJump(instruction->jump))
+        return field(instruction->jump, instruction->jumpStart);
+    }
+
+    return {hack::utf16Column(lineText, begin),
+            hack::utf16Column(lineText, end)};
+  }
+
+  static uint64_t
+  digest(const std::vector<lsp::DiagnosticMessage> &diagnostics) {
+    uint64_t digest = hash::combine(0, diagnostics.size());
+    for (const auto &diagnostic : diagnostics) {
+      digest = hash::combine(digest, static_cast<uint64_t>(diagnostic.line));
+      digest =
+          hash::combine(digest, static_cast<uint64_t>(diagnostic.character));
+      digest =
+          hash::combine(digest, static_cast<uint64_t>(diagnostic.endCharacter));
+      digest =
+          hash::combine(digest, static_cast<uint64_t>(diagnostic.severity));
+      digest = hash::combine(digest, hash::hash64(diagnostic.message));
+    }
+    return digest;
+  }
+
+  void
+  publishDiagnostics(const std::string &uri,
+                     const std::vector<lsp::DiagnosticMessage> &diagnostics) {
+    // Skip sending if identical to last published for this URI
+    uint64_t current = digest(diagnostics);
+    auto it = lastPublishedByUri.find(uri);
+    if (it != lastPublishedByUri.end() && it->second == current) {
+      return;
+    }
+
+    nlohmann::ordered_json params;
+    params["uri"] = uri;
+    params["diagnostics"] = toJson(diagnostics);
 
     io.sendNotification("textDocument/publishDiagnostics", params);
-    lastPublishedByUri[uri] = diagnostics;
+    lastPublishedByUri[uri] = current;
   }
 };
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "core/structures/TextDocument.hpp"
+#include "hack/HackSyntax.hpp"
+
+// What the changes of one didChange touched, found by comparing the lines
+// they replaced with the lines that replaced them. Lines are compared by
+// their code as the assembler reads it (hack::appendCompactCode), the part
+// before any comment without whitespace: if the code lines read the same
+// before and after, the instructions, and with them the symbols and
+// diagnostics, are unchanged and only move.
+class EditImpact {
+public:
+  enum Kind : uint8_t {
+    Whitespace = 1 << 0,
+    Comment = 1 << 1,
+    Label = 1 << 2,
+    AInstruction = 1 << 3,
+    CInstruction = 1 << 4,
+  };
+
+  static EditImpact classify(std::string_view before, std::string_view after,
+                             const std::vector<LineSplice> &splices) {
+    EditImpact impact;
+    if (splices.empty())
+      return impact;
+
+    LineSplice span = bounds(splices);
+    auto removed = lines(before, span.startLine, span.removedLines);
+    auto added = lines(after, span.startLine, span.addedLines);
+
+    // Lines the changes rewrote to what they were are not touched
+    size_t common = std::min(removed.size(), added.size());
+    size_t prefix = 0;
+    while (prefix < common && removed[prefix] == added[prefix])
+      prefix++;
+    size_t suffix = 0;
+    while (suffix < common - prefix &&
+           removed[removed.size() - 1 - suffix] ==
+               added[added.size() - 1 - suffix])
+      suffix++;
+
+    impact.span = {span.startLine + static_cast<int>(prefix),
+                   static_cast<int>(removed.size() - prefix - suffix),
+                   static_cast<int>(added.size() - prefix - suffix)};
+
+    Parts old, now;
+    for (size_t i = prefix; i < removed.size() - suffix; i++) {
+      old.add(removed[i], span.startLine + static_cast<int>(i));
+    }
+    for (size_t i = prefix; i < added.size() - suffix; i++) {
+      now.add(added[i], span.startLine + static_cast<int>(i));
+    }
+
+    if (old.comments != now.comments)
+      impact.kinds |= Comment;
+    if (old.uncommented != now.uncommented)
+      impact.kinds |= Whitespace;
+
+    bool sameCode = std::equal(old.code.begin(), old.code.end(),
+                               now.code.begin(), now.code.end(),
+                               [](const auto &lhs, const auto &rhs) {
+                                 return lhs.second == rhs.second;
+                               });
+    // Then the lines differ in their code, not just in its spacing
+    if (!sameCode) {
+      impact.kinds &= ~Whitespace;
+      for (const auto *parts : {&old, &now}) {
+        for (const auto &[line, code] : parts->code) {
+          impact.kinds |= kindOf(code);
+        }
+      }
+      return impact;
+    }
+
+    for (size_t i = 0; i < old.code.size(); i++) {
+      impact.codeLines.push_back({old.code[i].first, now.code[i].first});
+    }
+    return impact;
+  }
+
+  bool touches(Kind kind) const { return (kinds & kind) != 0; }
+
+  bool touchesCode() const {
+    return (kinds & (Label | AInstruction | CInstruction)) != 0;
+  }
+
+  // Where a 0-based line of the text before the change is in the text after
+  // it. Only meaningful if no code was touched; nullopt for blank and
+  // comment lines the change rewrote.
+  std::optional<int> moveLine(int line) const {
+    if (line < span.startLine)
+      return line;
+    if (line >= span.startLine + span.removedLines)
+      return line + span.addedLines - span.removedLines;
+
+    for (const auto &[from, to] : codeLines) {
+      if (from == line)
+        return to;
+    }
+    return std::nullopt;
+  }
+
+private:
+  uint8_t kinds = 0;
+  LineSplice span{0, 0, 0}; // the lines that differ
+  std::vector<std::pair<int, int>> codeLines; // inside span, before -> after
+
+  // One splice covering every splice of a change, which are in application
+  // order and each relative to the text the previous one left
+  static LineSplice bounds(const std::vector<LineSplice> &splices) {
+    LineSplice span = splices.front();
+    for (size_t i = 1; i < splices.size(); i++) {
+      span = span.then(splices[i]);
+    }
+    return span;
+  }
+
+  // Up to count lines of text from line first on
+  static std::vector<std::string_view> lines(std::string_view text, int first,
+                                             int count) {
+    size_t offset = 0;
+    for (int line = 0; line < first; line++) {
+      offset = text.find('\n', offset);
+      if (offset == std::string_view::npos)
+        return {};
+      offset++;
+    }
+
+    std::vector<std::string_view> found;
+    hack::forEachLine(text.substr(offset), [&](int, std::string_view line) {
+      if (found.size() == static_cast<size_t>(count))
+        return false;
+      found.push_back(line);
+      return true;
+    });
+    return found;
+  }
+
+  static Kind kindOf(std::string_view code) {
+    if (code[0] == '(')
+      return Label;
+    return code[0] == '@' ? AInstruction : CInstruction;
+  }
+
+  // The differing lines on one side of a change, taken apart
+  struct Parts {
+    std::vector<std::pair<int, std::string>> code; // line, compact code
+    std::vector<std::string_view> comments;
+    std::vector<std::string_view> uncommented;
+
+    void add(std::string_view line, int number) {
+      std::string_view instruction = hack::stripComment(line);
+      uncommented.push_back(instruction);
+      if (instruction.size() < line.size())
+        comments.push_back(line.substr(instruction.size()));
+
+      std::string compact;
+      hack::appendCompactCode(instruction, compact);
+      if (!compact.empty())
+        code.push_back({number, std::move(compact)});
+    }
+  };
+};
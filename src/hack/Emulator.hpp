@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace hack {
+
+// Every comp mnemonic with its a+c bits and how the ALU computes it from the
+// A, D and M registers. Expanded once into the op kinds and once into their
+// handlers so the two cannot drift apart.
+#define HACK_COMPS(X)                                                          \
+  X(ZERO, 0b0101010, 0)                                                        \
+  X(ONE, 0b0111111, 1)                                                         \
+  X(MINUS_ONE, 0b0111010, -1)                                                  \
+  X(D, 0b0001100, d)                                                           \
+  X(A, 0b0110000, a)                                                           \
+  X(NOT_D, 0b0001101, ~d)                                                      \
+  X(NOT_A, 0b0110001, ~a)                                                      \
+  X(NEG_D, 0b0001111, -d)                                                      \
+  X(NEG_A, 0b0110011, -a)                                                      \
+  X(D_PLUS_1, 0b0011111, d + 1)                                                \
+  X(A_PLUS_1, 0b0110111, a + 1)                                                \
+  X(D_MINUS_1, 0b0001110, d - 1)                                               \
+  X(A_MINUS_1, 0b0110010, a - 1)                                               \
+  X(D_PLUS_A, 0b0000010, d + a)                                                \
+  X(D_MINUS_A, 0b0010011, d - a)                                               \
+  X(A_MINUS_D, 0b0000111, a - d)                                               \
+  X(D_AND_A, 0b0000000, d & a)                                                 \
+  X(D_OR_A, 0b0010101, d | a)                                                  \
+  X(M, 0b1110000, MEM)                                                         \
+  X(NOT_M, 0b1110001, ~MEM)                                                    \
+  X(NEG_M, 0b1110011, -MEM)                                                    \
+  X(M_PLUS_1, 0b1110111, MEM + 1)                                              \
+  X(M_MINUS_1, 0b1110010, MEM - 1)                                             \
+  X(D_PLUS_M, 0b1000010, d + MEM)                                              \
+  X(D_MINUS_M, 0b1010011, d - MEM)                                             \
+  X(M_MINUS_D, 0b1000111, MEM - d)                                             \
+  X(D_AND_M, 0b1000000, d & MEM)                                               \
+  X(D_OR_M, 0b1010101, d | MEM)
+
+// Hack CPU. The program is decoded once into an array of small ops whose
+// kind is the ALU function itself, so executing an instruction is a single
+// indirect jump to a handler that computes, stores and branches without
+// looking at any bits. With GCC and Clang the handlers jump straight to the
+// next one through a label table (threaded dispatch); other compilers get
+// the same handlers behind a switch.
+//
+// The usual end of a Hack program, "(END) @END 0;JMP", is decoded as a halt
+// so a finished program stops instead of spinning until the cycle limit.
+class Emulator {
+public:
+  static constexpr size_t RAM_SIZE = 1 << 15;
+
+  struct State {
+    uint64_t cycles = 0;
+    bool halted = false; // reached a halt loop or ran past the last word
+    uint16_t pc = 0;
+    uint16_t a = 0;
+    uint16_t d = 0;
+  };
+
+  explicit Emulator(const std::vector<uint16_t> &words)
+      : program(decode(words)), ram(RAM_SIZE, 0) {}
+
+  // Runs from a reset CPU for at most maxCycles instructions
+  State run(uint64_t maxCycles) {
+    std::fill(ram.begin(), ram.end(), 0);
+
+    const Op *ops = program.data();
+    const uint16_t end = static_cast<uint16_t>(program.size() - 1);
+    uint16_t *cells = ram.data();
+
+    State state;
+    uint64_t cycles = 0;
+    uint16_t pc = 0, a = 0, d = 0;
+    const Op *op = nullptr;
+
+#define MEM cells[a & (RAM_SIZE - 1)]
+
+    // Stores out into the op's destinations and takes its jump. M and the
+    // jump target use A as it was before this instruction.
+#define STORE(out)                                                             \
+  do {                                                                         \
+    uint16_t value = static_cast<uint16_t>(out);                               \
+    uint16_t address = a;                                                      \
+    if (op->dest & 0b001)                                                      \
+      cells[address & (RAM_SIZE - 1)] = value;                                 \
+    if (op->dest & 0b010)                                                      \
+      d = value;                                                               \
+    if (op->dest & 0b100)                                                      \
+      a = value;                                                               \
+    if (op->jump & condition(value))                                           \
+      pc = std::min(address, end);                                             \
+  } while (0)
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#define HANDLER_ADDRESS(kind, bits, expr) &&op_##kind,
+    static const void *const handlers[] = {
+        &&op_LOAD_A, &&op_HALT, &&op_END, HACK_COMPS(HANDLER_ADDRESS)};
+#undef HANDLER_ADDRESS
+
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    if (cycles == maxCycles)                                                   \
+      goto done;                                                               \
+    cycles++;                                                                  \
+    op = &ops[pc++];                                                           \
+    goto *handlers[op->kind];                                                  \
+  } while (0)
+
+#define HANDLER(kind) op_##kind:
+#define NEXT() DISPATCH()
+
+    DISPATCH();
+#else
+#define HANDLER(kind) case Kind::kind:
+#define NEXT() break
+
+    while (cycles < maxCycles) {
+      cycles++;
+      op = &ops[pc++];
+      switch (op->kind) {
+#endif
+
+    HANDLER(LOAD_A) {
+      a = op->value;
+      NEXT();
+    }
+
+    HANDLER(HALT) {
+      a = op->value;
+      pc--;
+      state.halted = true;
+      goto done;
+    }
+
+    HANDLER(END) {
+      cycles--;
+      pc--;
+      state.halted = true;
+      goto done;
+    }
+
+#define COMP_HANDLER(kind, bits, expr)                                         \
+  HANDLER(kind) {                                                              \
+    STORE(expr);                                                               \
+    NEXT();                                                                    \
+  }
+    HACK_COMPS(COMP_HANDLER)
+#undef COMP_HANDLER
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#undef DISPATCH
+#else
+      }
+    }
+#endif
+
+#undef NEXT
+#undef HANDLER
+#undef STORE
+#undef MEM
+
+  done:
+    state.cycles = cycles;
+    state.pc = pc;
+    state.a = a;
+    state.d = d;
+    return state;
+  }
+
+  // RAM after the last run
+  uint16_t memory(uint16_t address) const {
+    return ram[address & (RAM_SIZE - 1)];
+  }
+
+private:
+  enum Kind : uint8_t {
+    LOAD_A,
+    HALT, // @self of a halt loop
+    END,  // one past the last word
+#define COMP_KIND(kind, bits, expr) kind,
+    HACK_COMPS(COMP_KIND)
+#undef COMP_KIND
+  };
+
+  struct Op {
+    Kind kind;
+    uint8_t dest;
+    uint8_t jump;
+    uint16_t value; // A-instruction constant
+  };
+
+  std::vector<Op> program; // decoded words plus a trailing END
+  std::vector<uint16_t> ram;
+
+  // Jump bits j1 j2 j3 select < 0, = 0 and > 0
+  static uint8_t condition(uint16_t value) {
+    int16_t signedValue = static_cast<int16_t>(value);
+    return signedValue < 0 ? 0b100 : signedValue == 0 ? 0b010 : 0b001;
+  }
+
+  static std::vector<Op> decode(const std::vector<uint16_t> &words) {
+    // a+c bits to op kind; unknown ALU functions halt like running off the end
+    std::array<Kind, 128> comps;
+    comps.fill(END);
+#define COMP_ENTRY(kind, bits, expr) comps[bits] = kind;
+    HACK_COMPS(COMP_ENTRY)
+#undef COMP_ENTRY
+
+    // The last slot is END, so words beyond it are never reached
+    size_t count = std::min(words.size(), size_t(RAM_SIZE) - 1);
+    std::vector<Op> ops;
+    ops.reserve(count + 1);
+
+    for (size_t i = 0; i < count; i++) {
+      uint16_t word = words[i];
+      if ((word & 0x8000) == 0) {
+        ops.push_back({LOAD_A, 0, 0, word});
+        continue;
+      }
+      ops.push_back({comps[(word >> 6) & 0x7F],
+                     static_cast<uint8_t>((word >> 3) & 0b111),
+                     static_cast<uint8_t>(word & 0b111), 0});
+    }
+    ops.push_back({END, 0, 0, 0});
+
+    // "@i" at i followed by an unconditional jump that stores nothing
+    for (size_t i = 0; i + 1 < count; i++) {
+      const Op &next = ops[i + 1];
+      if (ops[i].kind == LOAD_A && ops[i].value == i && next.kind != END &&
+          next.dest == 0 && next.jump == 0b111)
+        ops[i].kind = HALT;
+    }
+
+    return ops;
+  }
+};
+
+#undef HACK_COMPS
+
+} // namespace hack
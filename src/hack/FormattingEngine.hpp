@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <string>
+#include <string_view>
+
+#include "core/handlers/DocumentsHandler.hpp"
+#include "hack/HackSyntax.hpp"
+#include "lib/json_writer.hpp"
+#include "lsp/params.hpp"
+#include "lsp/responses.hpp"
+
+// Single-pass formatter: each line is formatted on its own and a TextEdit is
+// written straight into the response buffer only when the line changes.
+//
+//   - labels start at column 0, instructions are indented one level
+//   - whitespace inside instructions is removed (Hack ignores it)
+//   - trailing comments start at TRAILING_COMMENT_COLUMN or one space past
+//     the code, and "//comment" becomes "// comment"
+//   - trailing whitespace is trimmed
+class FormattingEngine {
+public:
+  FormattingEngine(DocumentsHandler &_documentsHandler)
+      : documentsHandler(_documentsHandler) {}
+
+  lsp::RawResult format(lsp::DocumentFormattingParams &params) {
+    return formatLines(params.textDocument.uri, params.options, 0, INT_MAX);
+  }
+
+  lsp::RawResult rangeFormat(lsp::DocumentRangeFormattingParams &params) {
+    int last = params.range.end.line;
+
+    // A range ending at column 0 does not include that line
+    if (params.range.end.character == 0 && last > params.range.start.line)
+      last--;
+
+    return formatLines(params.textDocument.uri, params.options,
+                       params.range.start.line, last);
+  }
+
+private:
+  static constexpr size_t TRAILING_COMMENT_COLUMN = 20;
+
+  DocumentsHandler &documentsHandler;
+
+  lsp::RawResult formatLines(const std::string &uri,
+                             const lsp::FormattingOptions &options, int first,
+                             int last) {
+
+    const std::string indent =
+        options.insertSpaces ? std::string(std::max(options.tabSize, 0), ' ')
+                             : std::string("\t");
+
+    std::string json = "[";
+    std::string formatted;
+    bool firstEdit = true;
+
+    hack::forEachLine(
+        documentsHandler.snapshot(uri)->text,
+        [&](int line, std::string_view lineText) {
+          if (line < first)
+            return true;
+          if (line > last)
+            return false;
+
+          formatLine(lineText, indent, formatted);
+          if (formatted == lineText)
+            return true;
+
+          if (!firstEdit)
+            json += ',';
+          firstEdit = false;
+
+          json += R"({"range":{"start":{"line":)";
+          json_writer::appendInt(json, line);
+          json += R"(,"character":0},"end":{"line":)";
+          json_writer::appendInt(json, line);
+          json += R"(,"character":)";
+          json_writer::appendInt(json,
+                                 hack::utf16Column(lineText, lineText.size()));
+          json += R"(}},"newText":)";
+          json_writer::appendString(json, formatted);
+          json += '}';
+          return true;
+        });
+
+    json += ']';
+    return lsp::RawResult{std::move(json)};
+  }
+
+  static void formatLine(std::string_view lineText, const std::string &indent,
+                         std::string &out) {
+    out.clear();
+
+    std::string_view code = hack::stripComment(lineText);
+    std::string_view comment = lineText.substr(code.size());
+
+    hack::appendCompactCode(code, out);
+
+    if (!out.empty() && out[0] != '(')
+      out.insert(0, indent);
+
+    if (comment.empty())
+      return;
+
+    if (out.empty()) {
+      // Full-line comments keep column 0 or move to the instruction indent
+      if (lineText.find_first_not_of(" \t") != 0)
+        out += indent;
+    } else {
+      size_t column = std::max(TRAILING_COMMENT_COLUMN, out.size() + 1);
+      out.append(column - out.size(), ' ');
+    }
+
+    appendComment(comment, out);
+  }
+
+  static void appendComment(std::string_view comment, std::string &out) {
+    size_t end = comment.find_last_not_of(" \t");
+    comment = comment.substr(0, end + 1);
+
+    out += "//";
+    std::string_view body = comment.substr(2);
+    if (!body.empty() && body[0] != ' ' && body[0] != '\t' && body[0] != '/')
+      out += ' ';
+    out += body;
+  }
+};
@@ -1,9 +1,25 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "core/handlers/DocumentsHandler.hpp"
+#include "hack/AssemblyJob.hpp"
+#include "hack/AssemblyResult.hpp"
+#include "hack/ChunkedAssembler.hpp"
+#include "hack/EditImpact.hpp"
+#include "hack/ResultPool.hpp"
+#include "hack/ResultCache.hpp"
+#include "hack/SymbolIndex.hpp"
+#include "lib/hash.hpp"
 
 extern "C" {
 #include "assembler.h"
@@ -11,91 +27,376 @@ extern "C" {
 #include "types.h"
 }
 
+// Keeps the assembler result of open documents within a memory budget.
+// Results are ordered by last use; once the budget is exceeded the least
+// recently used ones are freed and rebuilt from the document text the next
+// time they are asked for.
+//
+// Results are shared by content: documents with identical text (the same
+// file opened under several paths, vendored copies) point at one immutable
+// result, which is assembled and counted against the budget once. A document
+// that diverges gets a result of its own and the others keep the old one.
+//
+// Results of opened and closed documents also go through the on-disk
+// ResultCache, with the symbol occurrences of their text, so an unchanged
+// file is mapped instead of assembled and indexed, and
+// through the process-wide ResultPool, so another session's result for the
+// same text is reused directly.
+//
+// begin()/resume() assemble documents of SLICED_ASSEMBLY_BYTES or more with
+// an AssemblyJob, in slices the caller interleaves with other work. A job
+// replaced by a newer one is cancelled and kept in retiring until its
+// thread is done, and the newer job only starts then.
 class HackAssembler {
 
 public:
-  HackAssembler(DocumentsHandler &_documentHandler)
-      : documentHandler(_documentHandler) {};
+  static constexpr size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+  static constexpr size_t SLICED_ASSEMBLY_BYTES = 1024 * 1024;
 
+  HackAssembler(DocumentsHandler &_documentHandler, ResultPool &_resultPool)
+      : documentHandler(_documentHandler), resultPool(_resultPool) {};
+
+  // Assembles the current text, e.g. after a change
   void run(const std::string &uri) {
+    auto document = documentHandler.snapshot(uri);
+    uint64_t contentHash = hash::hash64(document->text);
+
+    if (share(uri, contentHash))
+      return;
+
+    insert(uri, contentHash, assembleText(document->text, contentHash), false);
+  };
+
+  // Loads the result from the disk cache when the text is unchanged since it
+  // was stored, assembling and storing it otherwise
+  void open(const std::string &uri) {
+    auto document = documentHandler.snapshot(uri);
+    uint64_t contentHash = hash::hash64(document->text);
+
+    if (share(uri, contentHash))
+      return;
+
+    if (auto cached = resultCache.load(contentHash)) {
+      insert(uri, contentHash, std::move(*cached), true);
+      return;
+    }
+
+    run(uri);
+    persist(byContent.at(contentHash), document->text);
+  }
 
+  // Derives uri's result for its current text from the result for the text
+  // before a change that touched no code (see EditImpact): the symbols stay
+  // and the diagnostics move with their lines. Returns false, leaving uri as
+  // it was, if its result is not for that text or a diagnostic sat on a
+  // line the change rewrote.
+  bool shift(const std::string &uri, uint64_t previousHash,
+             const EditImpact &impact) {
     auto it = uriToAssembleResult.find(uri);
-    if (it != uriToAssembleResult.end()) {
-      freeURIResult(uri);
+    if (it == uriToAssembleResult.end() ||
+        it->second.contentHash != previousHash || jobs.contains(uri))
+      return false;
+
+    auto previous = byContent.at(previousHash).result;
+
+    std::vector<AssemblyResult::Problem> problems;
+    problems.reserve(previous->diagnosticCount());
+    for (size_t i = 0; i < previous->diagnosticCount(); i++) {
+      auto problem = previous->diagnostic(i);
+      auto line = impact.moveLine(problem.line - 1);
+      if (!line)
+        return false;
+      problems.push_back({*line + 1, problem.message});
     }
 
-    auto source = documentHandler.getText(uri);
+    uint64_t contentHash = hash::hash64(documentHandler.snapshot(uri)->text);
+    if (share(uri, contentHash))
+      return true;
 
-    AssemblerResult result = assemble(source.data(), assemblerConfig);
+    std::vector<AssemblyResult::Symbol> symbols;
+    symbols.reserve(previous->symbolCount());
+    for (size_t i = 0; i < previous->symbolCount(); i++) {
+      symbols.push_back(previous->symbol(i));
+    }
 
-    setUpTables(result.dests, result.comps, result.jumps);
-    uriToAssembleResult[uri] = result;
-  };
+    insert(uri, contentHash,
+           AssemblyResult::fromParts(symbols, problems, contentHash), false);
+    return true;
+  }
 
-  std::unordered_map<std::string, Vector *> getAllDiagnostics() const {
-    std::unordered_map<std::string, Vector *> diagnostics;
+  // Starts bringing uri's result up to date with its text, like open() or
+  // run(). Returns true if that is already done; otherwise the text is
+  // large and resume() must be called until it returns true.
+  bool begin(const std::string &uri, bool opening) {
+    retire(uri); // assembling an older version
 
-    for (const auto &entry : uriToAssembleResult) {
-      diagnostics[entry.first] = entry.second.diagnostics;
+    auto document = documentHandler.snapshot(uri);
+    if (document->text.size() < SLICED_ASSEMBLY_BYTES) {
+      opening ? open(uri) : run(uri);
+      return true;
     }
 
-    return diagnostics;
-  };
+    uint64_t contentHash = hash::hash64(document->text);
+    if (share(uri, contentHash))
+      return true;
 
-  Map *getSymbols(const std::string &uri) {
+    if (opening) {
+      if (auto cached = resultCache.load(contentHash)) {
+        insert(uri, contentHash, std::move(*cached), true);
+        return true;
+      }
+    }
+
+    jobs.insert_or_assign(
+        uri, Job{std::make_unique<AssemblyJob>(std::move(document),
+                                               contentHash, &assembleJob),
+                 opening});
+    return false;
+  }
+
+  // Works on uri's job for at most budget; true once its result is attached
+  bool resume(const std::string &uri, std::chrono::microseconds budget) {
+    auto it = jobs.find(uri);
+    if (it == jobs.end())
+      return true;
+
+    std::erase_if(retiring,
+                  [](const auto &entry) { return entry.second->finished(); });
+
+    auto &job = *it->second.assembly;
+    if (!retiring.contains(uri))
+      job.start();
+    if (!job.step(budget))
+      return false;
+
+    uint64_t contentHash = job.hash();
+    if (!share(uri, contentHash))
+      insert(uri, contentHash, job.takeResult(), false);
+    if (it->second.opening)
+      persist(byContent.at(contentHash), job.text());
+
+    jobs.erase(it);
+    return true;
+  }
+
+  // Labels found so far by uri's unfinished job, or nullptr
+  std::shared_ptr<const std::vector<std::string>>
+  partialLabels(const std::string &uri) const {
+    auto it = jobs.find(uri);
+    if (it == jobs.end())
+      return nullptr;
+    return it->second.assembly->partialLabels();
+  }
+
+  void openCache(const std::string &rootUri) { resultCache.open(rootUri); }
+
+  // Returns the result for uri, rebuilding it if it was evicted, or nullptr
+  // for documents that are not open or whose first assembly is a job still
+  // running
+  std::shared_ptr<const AssemblyResult> getResult(const std::string &uri) {
     auto it = uriToAssembleResult.find(uri);
     if (it == uriToAssembleResult.end()) {
-      return nullptr;
+      if (!documentHandler.contains(uri) || jobs.contains(uri))
+        return nullptr;
+
+      open(uri);
+      it = uriToAssembleResult.find(uri);
+    } else {
+      recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed,
+                          it->second.recent);
     }
-    return it->second.symbols;
+
+    return byContent.at(it->second.contentHash).result;
   };
 
-  const std::vector<std::string> &getDests() const { return dests; };
-  const std::vector<std::string> &getComps() const { return comps; };
-  const std::vector<std::string> &getJumps() const { return jumps; };
+  void setMemoryBudget(size_t bytes) {
+    memoryBudget = bytes;
+    evict();
+  }
 
+  // Called on close, before the document is dropped: the final state goes
+  // to the disk cache
   void freeURIResult(const std::string &uri) {
+    retire(uri);
+
     auto it = uriToAssembleResult.find(uri);
     if (it == uriToAssembleResult.end()) {
       return;
     }
 
-    AssemblerResult__free(&it->second, assemblerConfig);
-    uriToAssembleResult.erase(it);
+    if (auto document = documentHandler.find(uri))
+      persist(byContent.at(it->second.contentHash), document->text);
+    release(it);
   }
 
   void freeAllResults() {
-    for (auto &entry : uriToAssembleResult) {
-      AssemblerResult__free(&entry.second, assemblerConfig);
-    }
+    jobs.clear();
+    retiring.clear();
     uriToAssembleResult.clear();
+    byContent.clear();
+    recentlyUsed.clear();
+    totalBytes = 0;
+  }
+
+  // Runs the C assembler on one text, in chunks across cores when it is
+  // large enough. Holds no state, so batch callers may run it on several
+  // threads at once; they pass parallel = false so each text keeps to the
+  // thread it is on.
+  static AssemblyResult assembleText(std::string source, uint64_t contentHash,
+                                     bool parallel = true) {
+    if (parallel) {
+      if (auto chunked = ChunkedAssembler::assemble(
+              source, contentHash, std::thread::hardware_concurrency()))
+        return std::move(*chunked);
+    }
+
+    AssemblerConfig config = {0, 0};
+    AssemblerResult result = assemble(source.data(), config);
+    auto assembly = AssemblyResult::fromAssembler(result, contentHash);
+
+    AssemblerResult__free(&result, config);
+    return assembly;
   }
 
 private:
-  AssemblerConfig assemblerConfig = {0, 0};
+  struct Content {
+    std::shared_ptr<const AssemblyResult> result;
+    size_t documents; // URIs currently sharing this result
+    bool persisted;
+  };
+
+  struct Entry {
+    uint64_t contentHash;
+    std::list<std::string>::iterator recent;
+  };
+
+  struct Job {
+    std::unique_ptr<AssemblyJob> assembly;
+    bool opening; // store the result in the disk cache too
+  };
+
   DocumentsHandler &documentHandler;
-  std::unordered_map<std::string, AssemblerResult> uriToAssembleResult;
-  std::vector<std::string> dests, comps, jumps;
-  bool isSetUp = false;
+  ResultPool &resultPool;
+  ResultCache resultCache;
+  std::unordered_map<std::string, Entry> uriToAssembleResult;
+  std::unordered_map<uint64_t, Content> byContent;
+  std::list<std::string> recentlyUsed; // most recent first
+  std::unordered_map<std::string, Job> jobs;
+  // Cancelled jobs whose chunk under way has not finished
+  std::unordered_map<std::string, std::unique_ptr<AssemblyJob>> retiring;
+  size_t totalBytes = 0;
+  size_t memoryBudget = DEFAULT_MEMORY_BUDGET;
 
-  void setUpTables(Map *_dests, Map *_comps, Map *_jumps) {
-    if (isSetUp)
+  // Runs a job's assembly on the job's thread alone, one chunk at a time so
+  // cancelling it takes effect at the next chunk
+  static std::optional<AssemblyResult>
+  assembleJob(std::string_view source, uint64_t contentHash,
+              const std::atomic<bool> &cancelled) {
+    if (auto chunked =
+            ChunkedAssembler::assemble(source, contentHash, 1, &cancelled))
+      return chunked;
+    if (cancelled)
+      return std::nullopt;
+    return assembleText(std::string(source), contentHash, false);
+  }
+
+  // Cancels uri's job. One still running is kept until it is done, unless
+  // another is already waiting on it, in which case this one never started.
+  void retire(const std::string &uri) {
+    auto it = jobs.find(uri);
+    if (it == jobs.end())
       return;
 
-    extractKeys(_dests, dests);
-    extractKeys(_comps, comps);
-    extractKeys(_jumps, jumps);
+    auto job = std::move(it->second.assembly);
+    jobs.erase(it);
+    job->cancel();
+    if (!job->finished())
+      retiring.insert_or_assign(uri, std::move(job));
+  }
+
+  // Points uri at an existing result for the same content, if any
+  bool share(const std::string &uri, uint64_t contentHash) {
+    if (byContent.contains(contentHash)) {
+      attach(uri, contentHash);
+      return true;
+    }
+
+    // Assembled by another session; whoever built it stores it on close
+    if (auto pooled = resultPool.find(contentHash)) {
+      insert(uri, contentHash, std::move(pooled), true);
+      return true;
+    }
+    return false;
+  }
 
-    isSetUp = true;
+  void insert(const std::string &uri, uint64_t contentHash,
+              AssemblyResult result, bool persisted) {
+    auto shared = std::make_shared<const AssemblyResult>(std::move(result));
+    resultPool.add(contentHash, shared);
+    insert(uri, contentHash, std::move(shared), persisted);
   }
 
-  void extractKeys(Map *map, std::vector<std::string> &output) {
-    if (map == nullptr)
+  void insert(const std::string &uri, uint64_t contentHash,
+              std::shared_ptr<const AssemblyResult> result, bool persisted) {
+    totalBytes += result->memoryUsage();
+    byContent.emplace(contentHash,
+                      Content{std::move(result), 0, persisted});
+
+    attach(uri, contentHash);
+  }
+
+  void attach(const std::string &uri, uint64_t contentHash) {
+    auto &content = byContent.at(contentHash);
+    content.documents++;
+
+    auto it = uriToAssembleResult.find(uri);
+    if (it != uriToAssembleResult.end()) {
+      release(it);
+    }
+
+    recentlyUsed.push_front(uri);
+    uriToAssembleResult.emplace(uri, Entry{contentHash, recentlyUsed.begin()});
+
+    evict();
+  }
+
+  // Stores content's result with the occurrences of text, the text it was
+  // built from; a result that lags behind text is stored without them
+  void persist(Content &content, std::string_view text) {
+    if (content.persisted)
       return;
 
-    output.reserve(map->size);
-    for (int i = 0; i < map->size; i++) {
-      output.push_back(map->data[i].key);
+    if (hash::hash64(text) == content.result->contentHash()) {
+      auto symbols = DocumentSymbols::build(text);
+      resultCache.store(content.result->withOccurrences(symbols.records()));
+    } else {
+      resultCache.store(*content.result);
+    }
+    content.persisted = true;
+  }
+
+  // Detaches uri from its result, freeing the result once no document
+  // shares it. Readers holding the shared_ptr keep it alive until done.
+  void release(std::unordered_map<std::string, Entry>::iterator it) {
+    auto content = byContent.find(it->second.contentHash);
+    if (--content->second.documents == 0) {
+      totalBytes -= content->second.result->memoryUsage();
+      byContent.erase(content);
+    }
+
+    recentlyUsed.erase(it->second.recent);
+    uriToAssembleResult.erase(it);
+  }
+
+  // Frees least recently used results until the budget is met. The most
+  // recent result is always kept, however large. Evicted results are
+  // persisted so rebuilding them is a mapping rather than an assembly.
+  void evict() {
+    while (totalBytes > memoryBudget && recentlyUsed.size() > 1) {
+      auto it = uriToAssembleResult.find(recentlyUsed.back());
+      if (auto document = documentHandler.find(it->first))
+        persist(byContent.at(it->second.contentHash), document->text);
+      release(it);
     }
   }
-};
\ No newline at end of file
+};
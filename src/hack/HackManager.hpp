@@ -1,48 +1,252 @@
 #pragma once
 
+#include <chrono>
+#include <memory>
+#include <optional>
 #include <string>
 
+#include "core/Scheduler.hpp"
 #include "core/handlers/DocumentsHandler.hpp"
 #include "core/interfaces/IMessage.hpp"
+#include "hack/AddressMap.hpp"
+#include "hack/AssembledOutputEngine.hpp"
 #include "hack/CompletionEngine.hpp"
 #include "hack/DiagnosticsEngine.hpp"
+#include "hack/EditImpact.hpp"
+#include "hack/FormattingEngine.hpp"
 #include "hack/HackAssembler.hpp"
 #include "hack/HoverEngine.hpp"
+#include "hack/InlayHintEngine.hpp"
+#include "hack/RenameEngine.hpp"
+#include "hack/RunEngine.hpp"
+#include "hack/SemanticTokensEngine.hpp"
+#include "hack/SharedState.hpp"
+#include "hack/SymbolIndex.hpp"
+#include "hack/WorkspaceSymbolEngine.hpp"
+#include "lib/hash.hpp"
 #include "lsp/params.hpp"
 #include "lsp/responses.hpp"
 
 class HackManager {
 public:
-  HackManager(DocumentsHandler &_documentsHandler, IMessage &_io)
-      : hackAssembler(_documentsHandler), diagnosticsEngine(hackAssembler, _io),
+  HackManager(DocumentsHandler &_documentsHandler, IMessage &_io,
+              SharedState &_sharedState, Scheduler &_scheduler)
+      : documentsHandler(_documentsHandler), sharedState(_sharedState),
+        scheduler(_scheduler),
+        hackAssembler(_documentsHandler, _sharedState.results),
+        diagnosticsEngine(hackAssembler, _documentsHandler, _io),
         completionEngine(hackAssembler),
-        hoverEngine(hackAssembler, _documentsHandler) {}
+        hoverEngine(hackAssembler, _documentsHandler, addressMaps, runEngine),
+        renameEngine(symbolIndex),
+        workspaceSymbolEngine(symbolIndex),
+        semanticTokensEngine(_documentsHandler),
+        formattingEngine(_documentsHandler),
+        assembledOutputEngine(_documentsHandler, hackAssembler, _io),
+        runEngine(assembledOutputEngine, hackAssembler),
+        inlayHintEngine(addressMaps, symbolIndex, hackAssembler,
+                        _documentsHandler) {}
 
-  void processDocument(const std::string uri) {
-    // Step 1: Run assembler
-    hackAssembler.run(uri);
+  // Only the line bookkeeping of a change is done in place. Assembly,
+  // indexing and diagnostics run as background work, once per burst of
+  // changes; until then hover and completion see the previous result.
+  //
+  // previous is the text the change was applied to. A change that only
+  // touched comments and whitespace moves the lines of its result instead
+  // of assembling it again.
+  void processDocument(const std::string uri,
+                       const std::vector<LineSplice> &splices = {},
+                       const DocumentSnapshot &previous = nullptr) {
+    auto document = documentsHandler.snapshot(uri);
 
-    // Step 2: Publish diagnostics
-    diagnosticsEngine.report();
+    // Step 0: Invalidate cached tokens for the touched lines
+    semanticTokensEngine.applySplices(uri, splices);
+    assembledOutputEngine.applySplices(uri, splices);
+    runEngine.remove(uri);
+    addressMaps.update(uri, document->text, splices);
+
+    // Step 1: Move the previous result's lines, or run the assembler in the
+    // background
+    if (previous != nullptr) {
+      auto impact =
+          EditImpact::classify(previous->text, document->text, splices);
+      if (!impact.touchesCode() &&
+          hackAssembler.shift(uri, hash::hash64(previous->text), impact)) {
+        scheduler.postBackground(uri, [this, uri] {
+          indexAndReport(uri);
+          return false;
+        });
+        return;
+      }
+    }
+
+    queueAssembly(uri, false);
+  }
+
+  // Like processDocument, but an unchanged file's result comes from the
+  // disk cache instead of the assembler
+  void openDocument(const std::string &uri) {
+    addressMaps.update(uri, documentsHandler.snapshot(uri)->text, {});
+    queueAssembly(uri, true);
+  }
+
+  void setPullDiagnostics(bool enabled) { pullDiagnostics = enabled; }
+
+  void setMemoryBudget(size_t bytes) { hackAssembler.setMemoryBudget(bytes); }
+
+  lsp::RawResult inlayHints(lsp::InlayHintParams &params) {
+    return inlayHintEngine.hints(params);
+  }
+
+  lsp::RawResult assembledOutput(lsp::AssembledOutputParams &params) {
+    return assembledOutputEngine.output(params);
+  }
+
+  lsp::RawResult documentDiagnostic(lsp::DocumentDiagnosticParams &params) {
+    return diagnosticsEngine.documentDiagnostic(params);
+  }
+
+  // nullopt while the request is held (see DiagnosticsEngine)
+  std::optional<lsp::RawResult>
+  workspaceDiagnostic(const nlohmann::json &id,
+                      lsp::WorkspaceDiagnosticParams &params) {
+    return diagnosticsEngine.workspaceDiagnostic(id, params);
+  }
+
+  void cancelRequest(const nlohmann::json &id) { diagnosticsEngine.cancel(id); }
+
+  // Answers requests held for a change, e.g. before shutdown
+  void answerHeldRequests() { diagnosticsEngine.answerHeld(); }
+
+  // These return a job that may run on any thread
+  CompletionEngine::Job completion(const lsp::CompletionParams &params) {
+    return completionEngine.prepare(params);
+  }
+
+  HoverEngine::Job hover(const lsp::HoverParams &params) {
+    return hoverEngine.prepare(params);
+  }
+
+  RunEngine::Job run(const lsp::RunParams &params) {
+    return runEngine.prepare(params);
+  }
+
+  lsp::PrepareRenameResult prepareRename(lsp::PrepareRenameParams &params) {
+    return renameEngine.prepareRename(params);
   }
 
-  lsp::CompletionResult completion(lsp::CompletionParams &params) {
-    return completionEngine.completion(params);
+  lsp::RawResult rename(lsp::RenameParams &params) {
+    return renameEngine.rename(params);
   }
 
-  lsp::HoverResult hover(lsp::HoverParams &params) {
-    return hoverEngine.hover(params);
+  lsp::RawResult semanticTokensFull(lsp::SemanticTokensParams &params) {
+    return semanticTokensEngine.full(params);
+  }
+
+  lsp::RawResult semanticTokensRange(lsp::SemanticTokensRangeParams &params) {
+    return semanticTokensEngine.range(params);
+  }
+
+  lsp::RawResult semanticTokensDelta(lsp::SemanticTokensDeltaParams &params) {
+    return semanticTokensEngine.delta(params);
+  }
+
+  lsp::RawResult formatting(lsp::DocumentFormattingParams &params) {
+    return formattingEngine.format(params);
+  }
+
+  lsp::RawResult rangeFormatting(lsp::DocumentRangeFormattingParams &params) {
+    return formattingEngine.rangeFormat(params);
+  }
+
+  lsp::WorkspaceSymbolResult
+  workspaceSymbols(lsp::WorkspaceSymbolParams &params) {
+    return workspaceSymbolEngine.symbols(params);
+  }
+
+  void indexWorkspace(const std::string &rootUri) {
+    hackAssembler.openCache(rootUri);
+
+    // Sessions on the same root share one index of its files
+    workspace = sharedState.workspace(rootUri);
+    symbolIndex.layerOver(&workspace->files);
+  }
+
+  void onWatchedFilesChanged(lsp::DidChangeWatchedFilesParams &params) {
+    if (workspace)
+      workspace->indexer.onFilesChanged(params.changes);
   }
 
   void freeURIResult(const std::string &uri) {
+    scheduler.cancel(uri);
     hackAssembler.freeURIResult(uri);
+    semanticTokensEngine.remove(uri);
+    assembledOutputEngine.remove(uri);
+    runEngine.remove(uri);
+    addressMaps.remove(uri);
+    inlayHintEngine.remove(uri);
+    diagnosticsEngine.remove(uri);
+
+    // Fall back to the on-disk copy once the editor buffer is gone
+    symbolIndex.remove(uri);
+    if (workspace)
+      workspace->indexer.refresh(uri);
   }
 
   void freeAllResults() { hackAssembler.freeAllResults(); }
 
 private:
+  DocumentsHandler &documentsHandler;
+  SharedState &sharedState;
+  Scheduler &scheduler;
+  std::shared_ptr<SharedWorkspace> workspace;
   HackAssembler hackAssembler;
+  AddressMaps addressMaps;
   DiagnosticsEngine diagnosticsEngine;
   CompletionEngine completionEngine;
   HoverEngine hoverEngine;
+  SymbolIndex symbolIndex;
+  RenameEngine renameEngine;
+  WorkspaceSymbolEngine workspaceSymbolEngine;
+  SemanticTokensEngine semanticTokensEngine;
+  FormattingEngine formattingEngine;
+  AssembledOutputEngine assembledOutputEngine;
+  RunEngine runEngine;
+  InlayHintEngine inlayHintEngine;
+  bool pullDiagnostics = false;
+
+  // Longest a slice of a large document's assembly keeps the message
+  // thread from other work
+  static constexpr std::chrono::milliseconds ASSEMBLY_SLICE{5};
+
+  void queueAssembly(const std::string &uri, bool opening) {
+    auto step = [this, uri, opening, started = false]() mutable {
+      bool done = started ? hackAssembler.resume(uri, ASSEMBLY_SLICE)
+                          : hackAssembler.begin(uri, opening);
+      started = true;
+      if (!done)
+        return true;
+
+      indexAndReport(uri);
+      return false;
+    };
+    scheduler.postBackground(uri, std::move(step));
+  }
+
+  void indexAndReport(const std::string &uri) {
+    // Step 2: Index symbol occurrences, taken from the result if it came
+    // from the disk cache with those of the current text
+    auto document = documentsHandler.snapshot(uri);
+    auto result = hackAssembler.getResult(uri);
+    if (result && result->occurrenceCount() > 0 &&
+        result->contentHash() == hash::hash64(document->text))
+      symbolIndex.index(uri, DocumentSymbols::fromResult(*result));
+    else
+      symbolIndex.index(uri, document->text);
+
+    // Step 3: Publish diagnostics, or tell a held pull they may have changed
+    if (!pullDiagnostics)
+      diagnosticsEngine.report(uri);
+    else
+      diagnosticsEngine.refresh(uri);
+  }
 };
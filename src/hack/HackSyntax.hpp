@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "hack/PredefinedSymbols.hpp"
+#include "lib/utf16_to_utf8.hpp"
+
+namespace hack {
+
+// Symbols may contain letters, digits, '_', '.', '$' and ':' but must not
+// start with a digit
+inline bool isSymbolChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' ||
+         c == '$' || c == ':';
+}
+
+inline bool isSymbolStart(char c) {
+  return isSymbolChar(c) && !std::isdigit(static_cast<unsigned char>(c));
+}
+
+inline bool isValidSymbol(std::string_view name) {
+  if (name.empty() || !isSymbolStart(name[0]))
+    return false;
+  for (char c : name) {
+    if (!isSymbolChar(c))
+      return false;
+  }
+  return true;
+}
+
+// R0-R15, SP, LCL, ARG, THIS, THAT, SCREEN and KBD
+constexpr bool isPredefinedSymbol(std::string_view name) {
+  return predefinedValue(name).has_value();
+}
+
+// Returns the part of a line before any "//" comment
+inline std::string_view stripComment(std::string_view line) {
+  size_t pos = line.find("//");
+  return pos == std::string_view::npos ? line : line.substr(0, pos);
+}
+
+// Appends code (a line without its comment) as the assembler reads it. Hack
+// ignores spaces and tabs anywhere in an instruction, so "M = D + 1" is
+// "M=D+1", as InstructionTables' encode() also treats it.
+inline void appendCompactCode(std::string_view code, std::string &out) {
+  for (char c : code) {
+    if (c != ' ' && c != '\t')
+      out += c;
+  }
+}
+
+// The user label a "(NAME)" line declares, or an empty view
+inline std::string_view labelDeclaration(std::string_view line) {
+  std::string_view code = stripComment(line);
+
+  size_t i = code.find_first_not_of(" \t");
+  if (i == std::string_view::npos || code[i] != '(')
+    return {};
+
+  size_t start = i + 1;
+  size_t stop = start;
+  while (stop < code.size() && isSymbolChar(code[stop]))
+    stop++;
+
+  std::string_view name = code.substr(start, stop - start);
+  if (stop == code.size() || code[stop] != ')' || !isValidSymbol(name) ||
+      isPredefinedSymbol(name))
+    return {};
+  return name;
+}
+
+// Converts a UTF-8 byte offset within a line to a UTF-16 column, skipping the
+// conversion entirely for plain ASCII lines
+inline int utf16Column(std::string_view line, size_t byteOffset) {
+  for (size_t i = 0; i < byteOffset && i < line.size(); i++) {
+    if (static_cast<unsigned char>(line[i]) >= 0x80) {
+      return static_cast<int>(utf16_to_utf8::getUtf16CodeUnitCountUpToOffset(
+          std::string(line), byteOffset));
+    }
+  }
+  return static_cast<int>(byteOffset);
+}
+
+// Calls fn(lineNumber, lineText) for every line in text, without copying.
+// If fn returns bool, returning false stops the walk early
+template <typename Fn> void forEachLine(std::string_view text, Fn &&fn) {
+  using Result = std::invoke_result_t<Fn, int, std::string_view>;
+
+  size_t offset = 0;
+  int line = 0;
+  while (offset <= text.size()) {
+    size_t end = text.find('\n', offset);
+    if (end == std::string_view::npos)
+      end = text.size();
+
+    std::string_view lineText = text.substr(offset, end - offset);
+    if (!lineText.empty() && lineText.back() == '\r')
+      lineText.remove_suffix(1);
+
+    if constexpr (std::is_same_v<Result, bool>) {
+      if (!fn(line, lineText))
+        break;
+    } else {
+      fn(line, lineText);
+    }
+
+    if (end == text.size())
+      break;
+    offset = end + 1;
+    line++;
+  }
+}
+
+} // namespace hack
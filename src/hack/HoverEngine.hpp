@@ -1,59 +1,155 @@
 #pragma once
 
 #include <cctype>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include "core/handlers/DocumentsHandler.hpp"
+#include "hack/AddressMap.hpp"
 #include "hack/HackAssembler.hpp"
+#include "hack/HackSyntax.hpp"
+#include "hack/InstructionTables.hpp"
+#include "hack/PredefinedSymbols.hpp"
+#include "hack/RunEngine.hpp"
 #include "lib/utf16_to_utf8.hpp"
 #include "lsp/params.hpp"
 #include "lsp/responses.hpp"
 #include "lsp/types.hpp"
 
+// Hovers run on the request workers. prepare() takes everything a hover
+// reads on the message thread, as snapshots of the document's current
+// version, and the returned job computes the hover from those alone.
 class HoverEngine {
 public:
+  using Job = std::function<lsp::HoverResult()>;
+
   HoverEngine(HackAssembler &_hackAssembler,
-              DocumentsHandler &_documentsHandler)
-      : hackAssembler(_hackAssembler), documentsHandler(_documentsHandler) {};
+              DocumentsHandler &_documentsHandler, AddressMaps &_addressMaps,
+              RunEngine &_runEngine)
+      : hackAssembler(_hackAssembler), documentsHandler(_documentsHandler),
+        addressMaps(_addressMaps), runEngine(_runEngine) {};
+
+  Job prepare(const lsp::HoverParams &params) {
+    const std::string &uri = params.textDocument.uri;
+
+    return [document = documentsHandler.snapshot(uri),
+            result = hackAssembler.getResult(uri),
+            address = addressMaps.address(uri, params.position.line),
+            lastRun = runEngine.lastRun(uri), position = params.position] {
+      return hover(*document, result.get(), address, lastRun.get(), position);
+    };
+  }
+
+private:
+  HackAssembler &hackAssembler;
+  DocumentsHandler &documentsHandler;
+  AddressMaps &addressMaps;
+  RunEngine &runEngine;
 
-  lsp::HoverResult hover(lsp::HoverParams &params) {
+  static lsp::HoverResult hover(const TextDocument &document,
+                                const AssemblyResult *result,
+                                std::optional<uint32_t> address,
+                                const RunEngine::Watches *lastRun,
+                                lsp::Position position) {
 
-    auto &text = documentsHandler.getText(params.textDocument.uri);
-    auto res = getWordUnderCursor(params.position, text);
+    const std::string &text = document.text;
+    auto res = getWordUnderCursor(position, text);
 
     if (!res.first.starts_with("@"))
-      return lsp::HoverResult(nullptr);
+      return instructionHover(position, text, address);
 
-    auto symbols = hackAssembler.getSymbols(params.textDocument.uri);
+    std::string_view name = std::string_view(res.first).substr(1);
 
     int val = 0;
     bool found = false;
 
-    for (int i = 0; i < symbols->size; i++) {
-      if (res.first.substr(1) == symbols->data[i].key) {
-        val = symbols->data[i].value;
+    // Built-ins resolve without touching the document's result
+    if (auto predefined = hack::predefinedValue(name)) {
+      val = *predefined;
+      found = true;
+    } else if (result != nullptr) {
+      if (auto value = result->value(name)) {
+        val = *value;
         found = true;
-        break;
       }
     }
 
-    if (!found)
+    if (!found && !address)
       return lsp::HoverResult(nullptr);
 
-    std::string contents = res.first + " = " + std::to_string(val) +
-                           "\n\n✨ This symbol sets the A and M registers to " +
-                           std::to_string(val);
+    std::string contents = res.first;
+    if (found)
+      contents += " = " + std::to_string(val) +
+                  "\n\n✨ This symbol sets the A and M registers to " +
+                  std::to_string(val);
+    if (lastRun != nullptr) {
+      auto value = lastRun->find(std::string(name));
+      if (value != lastRun->end())
+        contents += "\n\nLast run: " + std::to_string(value->second);
+    }
+    contents += addressLine(address);
 
     return lsp::HoverItem{.contents = contents, .range = res.second};
   };
 
-private:
-  HackAssembler &hackAssembler;
-  DocumentsHandler &documentsHandler;
+  static std::string addressLine(std::optional<uint32_t> address) {
+    if (!address)
+      return "";
+    return "\n\nROM address " + std::to_string(*address);
+  }
+
+  // Shows the machine code of the C-instruction under the cursor
+  static lsp::HoverResult instructionHover(const lsp::Position &pos,
+                                           const std::string &text,
+                                           std::optional<uint32_t> address) {
+    std::string_view lineText;
+    hack::forEachLine(text, [&](int line, std::string_view current) {
+      if (line < pos.line)
+        return true;
+      if (line == pos.line)
+        lineText = current;
+      return false;
+    });
+
+    std::string_view code = hack::stripComment(lineText);
+    auto instruction = hack::parseCInstruction(code);
+    if (!instruction)
+      return lsp::HoverResult(nullptr);
+
+    auto bits = hack::encode(*instruction);
+    if (!bits)
+      return lsp::HoverResult(nullptr);
+
+    size_t begin = code.find_first_not_of(" \t");
+    size_t end = code.find_last_not_of(" \t") + 1;
+    int startColumn = hack::utf16Column(lineText, begin);
+    int endColumn = hack::utf16Column(lineText, end);
+    if (pos.character < startColumn || pos.character > endColumn)
+      return lsp::HoverResult(nullptr);
+
+    std::string binary;
+    for (int bit = 15; bit >= 0; bit--) {
+      binary += (*bits >> bit) & 1 ? '1' : '0';
+    }
+
+    std::string contents =
+        std::string(code.substr(begin, end - begin)) + " = " + binary +
+        "\n\n✨ 111 a=" + binary.substr(3, 1) + " comp=" + binary.substr(4, 6) +
+        " dest=" + binary.substr(10, 3) + " jump=" + binary.substr(13, 3) +
+        addressLine(address);
+
+    return lsp::HoverItem{.contents = contents,
+                          .range = {{pos.line, startColumn},
+                                    {pos.line, endColumn}}};
+  }
 
-  std::pair<std::string, lsp::Range>
-  getWordUnderCursor(lsp::Position &pos, const std::string &text) {
+  static std::pair<std::string, lsp::Range>
+  getWordUnderCursor(const lsp::Position &pos, const std::string &text) {
 
     // Extract the line at pos.line
     size_t offset = 0;
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/handlers/DocumentsHandler.hpp"
+#include "hack/AddressMap.hpp"
+#include "hack/HackAssembler.hpp"
+#include "hack/SymbolIndex.hpp"
+#include "lib/json_writer.hpp"
+#include "lsp/params.hpp"
+#include "lsp/responses.hpp"
+
+// Two kinds of hints for the requested range: the ROM address of every
+// instruction, at the start of its line, and the resolved value after every
+// @LABEL or @variable reference. Only the AddressMap, the occurrences inside
+// the range and the result's symbol table are read, so the cost follows the
+// size of the range and not of the document.
+//
+// Editors ask for the same visible range repeatedly while scrolling back
+// and forth, so the serialized hints are kept per (version, lines) until the
+// document changes.
+class InlayHintEngine {
+public:
+  InlayHintEngine(AddressMaps &_addressMaps, SymbolIndex &_symbolIndex,
+                  HackAssembler &_hackAssembler,
+                  DocumentsHandler &_documentsHandler)
+      : addressMaps(_addressMaps), symbolIndex(_symbolIndex),
+        hackAssembler(_hackAssembler), documentsHandler(_documentsHandler) {}
+
+  lsp::RawResult hints(lsp::InlayHintParams &params) {
+    const std::string &uri = params.textDocument.uri;
+    int first = params.range.start.line;
+    int last = params.range.end.line;
+
+    auto document = documentsHandler.find(uri);
+    if (document == nullptr)
+      return lsp::RawResult{"[]"};
+
+    auto &cached = uriToHints[uri];
+    if (cached.version != document->version) {
+      cached.version = document->version;
+      cached.ranges.clear();
+    }
+
+    auto it = cached.ranges.find({first, last});
+    if (it != cached.ranges.end())
+      return lsp::RawResult{it->second};
+
+    std::string json = serialize(uri, first, last);
+    if (cached.ranges.size() >= MAX_CACHED_RANGES)
+      cached.ranges.clear();
+    cached.ranges.emplace(std::make_pair(first, last), json);
+
+    return lsp::RawResult{std::move(json)};
+  }
+
+  void remove(const std::string &uri) { uriToHints.erase(uri); }
+
+private:
+  static constexpr size_t MAX_CACHED_RANGES = 64;
+
+  struct CachedHints {
+    int version = -1;
+    std::map<std::pair<int, int>, std::string> ranges; // [first, last] lines
+  };
+
+  AddressMaps &addressMaps;
+  SymbolIndex &symbolIndex;
+  HackAssembler &hackAssembler;
+  DocumentsHandler &documentsHandler;
+  std::unordered_map<std::string, CachedHints> uriToHints;
+
+  std::string serialize(const std::string &uri, int first, int last) {
+    std::string json = "[";
+    bool empty = true;
+
+    auto open = [&]() {
+      if (!empty)
+        json += ',';
+      empty = false;
+    };
+
+    // References in the range, in document order
+    auto symbols = symbolIndex.get(uri);
+    auto result = hackAssembler.getResult(uri);
+    std::vector<SymbolOccurrence> none;
+    const auto &occurrences =
+        symbols != nullptr && result != nullptr ? symbols->occurrences : none;
+    auto reference = std::lower_bound(
+        occurrences.begin(), occurrences.end(), first,
+        [](const SymbolOccurrence &occurrence, int line) {
+          return occurrence.line < line;
+        });
+
+    // Both walks are in line order, so the value hint of a line follows its
+    // address hint
+    auto flushReferences = [&](int upTo) {
+      for (; reference != occurrences.end() && reference->line <= upTo;
+           reference++) {
+        if (reference->declaration)
+          continue;
+
+        auto value = result->value(symbols->names[reference->symbol]);
+        if (!value)
+          continue;
+
+        open();
+        json += R"({"position":{"line":)";
+        json_writer::appendInt(json, reference->line);
+        json += R"(,"character":)";
+        json_writer::appendInt(json, reference->end);
+        json += R"(},"label":"= )";
+        json_writer::appendInt(json, *value);
+        json += R"(","paddingLeft":true})";
+      }
+    };
+
+    addressMaps.forEachAddress(
+        uri, first, last, [&](size_t line, uint32_t address) {
+          flushReferences(static_cast<int>(line) - 1);
+
+          open();
+          json += R"({"position":{"line":)";
+          json_writer::appendInt(json, static_cast<int64_t>(line));
+          json += R"(,"character":0},"label":")";
+          json_writer::appendInt(json, address);
+          json += R"(","paddingRight":true})";
+        });
+    flushReferences(last);
+
+    json += ']';
+    return json;
+  }
+};
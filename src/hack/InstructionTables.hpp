@@ -0,0 +1,239 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace hack {
+
+struct Mnemonic {
+  std::string_view name;
+  uint16_t bits;
+};
+
+// Collision-free lookup table: the seed is searched at compile time until
+// every mnemonic lands in its own slot, so a lookup is one hash, one slot
+// read and one string compare.
+template <size_t Count, size_t Slots> class PerfectHashTable {
+public:
+  static_assert((Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+  static_assert(Count < Slots, "Slots must leave room for an empty marker");
+
+  constexpr explicit PerfectHashTable(
+      const std::array<Mnemonic, Count> &_entries)
+      : entries(_entries) {
+    for (seed = 1; seed < MAX_SEED; seed++) {
+      if (tryBuild())
+        return;
+    }
+    throw std::logic_error("no perfect hash seed found");
+  }
+
+  constexpr std::optional<uint16_t> find(std::string_view name) const {
+    uint8_t slot = slots[hash(name, seed) & (Slots - 1)];
+    if (slot == EMPTY || entries[slot].name != name)
+      return std::nullopt;
+    return entries[slot].bits;
+  }
+
+  constexpr const std::array<Mnemonic, Count> &all() const { return entries; }
+
+private:
+  static constexpr uint32_t MAX_SEED = 1 << 16;
+  static constexpr uint8_t EMPTY = 0xFF;
+
+  std::array<Mnemonic, Count> entries;
+  std::array<uint8_t, Slots> slots{};
+  uint32_t seed = 0;
+
+  // FNV-1a with the seed folded into the offset basis
+  static constexpr uint32_t hash(std::string_view name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (char c : name) {
+      h ^= static_cast<uint8_t>(c);
+      h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+  }
+
+  constexpr bool tryBuild() {
+    for (auto &slot : slots)
+      slot = EMPTY;
+
+    for (size_t i = 0; i < Count; i++) {
+      auto &slot = slots[hash(entries[i].name, seed) & (Slots - 1)];
+      if (slot != EMPTY)
+        return false;
+      slot = static_cast<uint8_t>(i);
+    }
+    return true;
+  }
+};
+
+// d1 d2 d3: A, D, M
+inline constexpr PerfectHashTable<9, 16> DESTS({{
+    {"M", 0b001},
+    {"D", 0b010},
+    {"DM", 0b011},
+    {"MD", 0b011},
+    {"A", 0b100},
+    {"AM", 0b101},
+    {"AD", 0b110},
+    {"ADM", 0b111},
+    {"AMD", 0b111},
+}});
+
+// a c1 c2 c3 c4 c5 c6
+inline constexpr PerfectHashTable<28, 64> COMPS({{
+    {"0", 0b0101010},   {"1", 0b0111111},   {"-1", 0b0111010},
+    {"D", 0b0001100},   {"A", 0b0110000},   {"!D", 0b0001101},
+    {"!A", 0b0110001},  {"-D", 0b0001111},  {"-A", 0b0110011},
+    {"D+1", 0b0011111}, {"A+1", 0b0110111}, {"D-1", 0b0001110},
+    {"A-1", 0b0110010}, {"D+A", 0b0000010}, {"D-A", 0b0010011},
+    {"A-D", 0b0000111}, {"D&A", 0b0000000}, {"D|A", 0b0010101},
+    {"M", 0b1110000},   {"!M", 0b1110001},  {"-M", 0b1110011},
+    {"M+1", 0b1110111}, {"M-1", 0b1110010}, {"D+M", 0b1000010},
+    {"D-M", 0b1010011}, {"M-D", 0b1000111}, {"D&M", 0b1000000},
+    {"D|M", 0b1010101},
+}});
+
+// j1 j2 j3: < 0, = 0, > 0
+inline constexpr PerfectHashTable<7, 16> JUMPS({{
+    {"JGT", 0b001},
+    {"JEQ", 0b010},
+    {"JGE", 0b011},
+    {"JLT", 0b100},
+    {"JNE", 0b101},
+    {"JLE", 0b110},
+    {"JMP", 0b111},
+}});
+
+static_assert(COMPS.find("D+M") == 0b1000010);
+static_assert(!COMPS.find("M+D"));
+
+// dest=comp;jump split of a C-instruction, fields trimmed of surrounding
+// whitespace. Offsets are byte offsets into the line the instruction came
+// from.
+struct CInstruction {
+  std::string_view dest, comp, jump;
+  size_t destStart = 0, compStart = 0, jumpStart = 0;
+};
+
+// Splits code (a line without its comment) into fields, or nullopt when the
+// line is empty, a label or an A-instruction
+constexpr std::optional<CInstruction> parseCInstruction(std::string_view code) {
+  auto trim = [&](size_t start, size_t end, std::string_view &field,
+                  size_t &fieldStart) {
+    while (start < end && (code[start] == ' ' || code[start] == '\t'))
+      start++;
+    while (end > start && (code[end - 1] == ' ' || code[end - 1] == '\t'))
+      end--;
+    field = code.substr(start, end - start);
+    fieldStart = start;
+  };
+
+  size_t begin = code.find_first_not_of(" \t");
+  if (begin == std::string_view::npos || code[begin] == '@' ||
+      code[begin] == '(')
+    return std::nullopt;
+  size_t end = code.find_last_not_of(" \t") + 1;
+
+  CInstruction instruction;
+  size_t compStart = begin;
+  size_t compEnd = end;
+
+  size_t semicolon = code.find(';', begin);
+  if (semicolon != std::string_view::npos && semicolon < end) {
+    trim(semicolon + 1, end, instruction.jump, instruction.jumpStart);
+    compEnd = semicolon;
+  }
+
+  size_t equals = code.find('=', begin);
+  if (equals != std::string_view::npos && equals < compEnd) {
+    trim(begin, equals, instruction.dest, instruction.destStart);
+    compStart = equals + 1;
+  }
+
+  trim(compStart, compEnd, instruction.comp, instruction.compStart);
+  return instruction;
+}
+
+namespace detail {
+
+// Hack ignores whitespace inside instructions, "D + 1" is "D+1". Mnemonics
+// are at most three characters, so longer fields are invalid anyway.
+struct Compact {
+  char text[4] = {};
+  size_t size = 0;
+  bool valid = true;
+
+  constexpr explicit Compact(std::string_view field) {
+    for (char c : field) {
+      if (c == ' ' || c == '\t')
+        continue;
+      if (size == sizeof(text)) {
+        valid = false;
+        return;
+      }
+      text[size++] = c;
+    }
+  }
+
+  constexpr std::string_view view() const { return {text, size}; }
+};
+
+template <typename Table>
+constexpr std::optional<uint16_t> lookup(const Table &table,
+                                         std::string_view field) {
+  Compact compact(field);
+  if (!compact.valid)
+    return std::nullopt;
+  return table.find(compact.view());
+}
+
+} // namespace detail
+
+// Validates a single field against its table
+constexpr bool isValidDest(std::string_view dest) {
+  return dest.empty() || detail::lookup(DESTS, dest).has_value();
+}
+constexpr bool isValidComp(std::string_view comp) {
+  return detail::lookup(COMPS, comp).has_value();
+}
+constexpr bool isValidJump(std::string_view jump) {
+  return jump.empty() || detail::lookup(JUMPS, jump).has_value();
+}
+
+// 111a cccc ccdd djjj, or nullopt if any field is unknown
+constexpr std::optional<uint16_t> encode(const CInstruction &instruction) {
+  auto comp = detail::lookup(COMPS, instruction.comp);
+  if (!comp)
+    return std::nullopt;
+
+  uint16_t dest = 0;
+  if (!instruction.dest.empty()) {
+    auto bits = detail::lookup(DESTS, instruction.dest);
+    if (!bits)
+      return std::nullopt;
+    dest = *bits;
+  }
+
+  uint16_t jump = 0;
+  if (!instruction.jump.empty()) {
+    auto bits = detail::lookup(JUMPS, instruction.jump);
+    if (!bits)
+      return std::nullopt;
+    jump = *bits;
+  }
+
+  return static_cast<uint16_t>(0b111 << 13 | *comp << 6 | dest << 3 | jump);
+}
+
+static_assert(encode(*parseCInstruction("D=D+A")) == 0b1110000010010000);
+static_assert(encode(*parseCInstruction(" 0;JMP ")) == 0b1110101010000111);
+static_assert(encode(*parseCInstruction("M = D + 1")) == 0b1110011111001000);
+
+} // namespace hack
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <string_view>
+
+namespace hack {
+
+struct PredefinedSymbol {
+  std::string_view name;
+  int value;
+};
+
+// Symbols every Hack program starts with, sorted by name so lookups can
+// binary search. Built at compile time and shared by all documents; the
+// per-document tables only hold user-defined labels and variables.
+inline constexpr std::array<PredefinedSymbol, 23> PREDEFINED_SYMBOLS = {{
+    {"ARG", 2},  {"KBD", 24576}, {"LCL", 1},  {"R0", 0},   {"R1", 1},
+    {"R10", 10}, {"R11", 11},    {"R12", 12}, {"R13", 13}, {"R14", 14},
+    {"R15", 15}, {"R2", 2},      {"R3", 3},   {"R4", 4},   {"R5", 5},
+    {"R6", 6},   {"R7", 7},      {"R8", 8},   {"R9", 9},   {"SCREEN", 16384},
+    {"SP", 0},   {"THAT", 4},    {"THIS", 3},
+}};
+
+static_assert(std::is_sorted(PREDEFINED_SYMBOLS.begin(),
+                             PREDEFINED_SYMBOLS.end(),
+                             [](const PredefinedSymbol &lhs,
+                                const PredefinedSymbol &rhs) {
+                               return lhs.name < rhs.name;
+                             }),
+              "PREDEFINED_SYMBOLS must be sorted by name");
+
+constexpr std::optional<int> predefinedValue(std::string_view name) {
+  auto it = std::lower_bound(
+      PREDEFINED_SYMBOLS.begin(), PREDEFINED_SYMBOLS.end(), name,
+      [](const PredefinedSymbol &symbol, std::string_view key) {
+        return symbol.name < key;
+      });
+
+  if (it == PREDEFINED_SYMBOLS.end() || it->name != name)
+    return std::nullopt;
+  return it->value;
+}
+
+static_assert(predefinedValue("SCREEN") == 16384);
+static_assert(!predefinedValue("R16"));
+
+} // namespace hack
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+
+#include "hack/HackSyntax.hpp"
+#include "hack/SymbolIndex.hpp"
+#include "lib/json_writer.hpp"
+#include "lsp/errors.hpp"
+#include "lsp/params.hpp"
+#include "lsp/responses.hpp"
+
+class RenameEngine {
+public:
+  RenameEngine(SymbolIndex &_symbolIndex) : symbolIndex(_symbolIndex) {}
+
+  lsp::PrepareRenameResult prepareRename(lsp::PrepareRenameParams &params) {
+
+    auto symbols = symbolIndex.get(params.textDocument.uri);
+    if (symbols == nullptr)
+      return nullptr;
+
+    auto occurrence = symbols->at(params.position);
+    if (occurrence == nullptr)
+      return nullptr;
+
+    return lsp::PrepareRenameItem{
+        .range = {{occurrence->line, occurrence->start},
+                  {occurrence->line, occurrence->end}},
+        .placeholder = symbols->names[occurrence->symbol]};
+  }
+
+  // Builds the WorkspaceEdit straight from the occurrence index, writing the
+  // edits into a single buffer instead of a json tree
+  lsp::RawResult rename(lsp::RenameParams &params) {
+
+    const std::string &uri = params.textDocument.uri;
+
+    auto symbols = symbolIndex.get(uri);
+    if (symbols == nullptr) {
+      lsp::Error error(lsp::ErrorCode::INTERNAL_ERROR, "URI not found");
+      throw error;
+    }
+
+    auto occurrence = symbols->at(params.position);
+    if (occurrence == nullptr) {
+      lsp::Error error(lsp::ErrorCode::REQUEST_FAILED,
+                       "No renameable label or variable at this position");
+      throw error;
+    }
+
+    const std::string &newName = params.newName;
+    if (!hack::isValidSymbol(newName) || hack::isPredefinedSymbol(newName)) {
+      lsp::Error error(lsp::ErrorCode::INVALID_PARAMS,
+                       "'" + newName + "' is not a valid Hack symbol name");
+      throw error;
+    }
+
+    auto existing = symbols->find(newName);
+    if (existing != nullptr && *existing != occurrence->symbol) {
+      lsp::Error error(lsp::ErrorCode::REQUEST_FAILED,
+                       "Symbol '" + newName + "' already exists");
+      throw error;
+    }
+
+    const auto &indices = symbols->byName[occurrence->symbol];
+    std::string quotedName;
+    json_writer::appendString(quotedName, newName);
+
+    std::string json;
+    json.reserve(uri.size() + indices.size() * (quotedName.size() + 80));
+
+    json += R"({"changes":{)";
+    json_writer::appendString(json, uri);
+    json += ":[";
+
+    for (size_t i = 0; i < indices.size(); i++) {
+      const auto &edit = symbols->occurrences[indices[i]];
+      if (i > 0)
+        json += ',';
+
+      json += R"({"range":{"start":{"line":)";
+      json_writer::appendInt(json, edit.line);
+      json += R"(,"character":)";
+      json_writer::appendInt(json, edit.start);
+      json += R"(},"end":{"line":)";
+      json_writer::appendInt(json, edit.line);
+      json += R"(,"character":)";
+      json_writer::appendInt(json, edit.end);
+      json += R"(}},"newText":)";
+      json += quotedName;
+      json += '}';
+    }
+
+    json += "]}}";
+
+    return lsp::RawResult{std::move(json)};
+  }
+
+private:
+  SymbolIndex &symbolIndex;
+};
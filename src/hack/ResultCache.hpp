@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+
+#include "hack/AssemblyResult.hpp"
+#include "lib/hash.hpp"
+#include "lsp/protocol.hpp"
+
+// Set by the build to the assembler's commit
+#ifndef HACKASM_VERSION
+#define HACKASM_VERSION "unknown"
+#endif
+
+// Per-workspace directory of AssemblyResult files named after the hash of
+// the text they were built from, so reopening an unchanged file maps its
+// result instead of running the assembler. Names also carry a hash of the
+// server and assembler versions: another build may report different
+// diagnostics for the same text, and its entries are left to age out.
+//
+// The directory is $XDG_CACHE_HOME/hack-ls/<hash of the root uri>, falling
+// back to ~/.cache. Entries not used for MAX_AGE are pruned when the cache
+// is opened.
+class ResultCache {
+public:
+  void open(const std::string &rootUri) {
+    std::filesystem::path base;
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+      base = xdg;
+    else if (const char *home = std::getenv("HOME"); home && *home)
+      base = std::filesystem::path(home) / ".cache";
+    else
+      return;
+
+    std::error_code ec;
+    auto path = base / "hack-ls" / hash::toHex(hash::hash64(rootUri));
+    std::filesystem::create_directories(path, ec);
+    if (ec)
+      return;
+
+    directory = path;
+    prune();
+  }
+
+  bool isOpen() const { return !directory.empty(); }
+
+  std::optional<AssemblyResult> load(uint64_t contentHash) {
+    if (!isOpen())
+      return std::nullopt;
+
+    auto path = entryPath(contentHash);
+    auto result = AssemblyResult::fromFile(path.string(), contentHash);
+
+    // Keep entries that are still in use from being pruned
+    if (result) {
+      std::error_code ec;
+      std::filesystem::last_write_time(
+          path, std::filesystem::file_time_type::clock::now(), ec);
+    }
+
+    return result;
+  }
+
+  // Writes through a temporary file so other servers sharing the directory
+  // never map a partially written entry
+  void store(const AssemblyResult &result) {
+    if (!isOpen())
+      return;
+
+    auto path = entryPath(result.contentHash());
+    auto temporary = path;
+    temporary += ".tmp" + std::to_string(::getpid());
+
+    std::string_view bytes = result.bytes();
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    out.close();
+
+    // A failed write (e.g. a full disk) may still have left part of a file
+    std::error_code ec;
+    if (!out) {
+      std::filesystem::remove(temporary, ec);
+      return;
+    }
+
+    std::filesystem::rename(temporary, path, ec);
+    if (ec)
+      std::filesystem::remove(temporary, ec);
+  }
+
+private:
+  static constexpr std::chrono::hours MAX_AGE{24 * 30};
+
+  std::filesystem::path directory;
+
+  std::filesystem::path entryPath(uint64_t contentHash) const {
+    static const std::string version = hash::toHex(hash::hash64(
+        std::string(protocol::serverDetails::SERVER_VERSION) + ":" +
+        HACKASM_VERSION));
+    return directory / (hash::toHex(contentHash) + "-" + version + ".bin");
+  }
+
+  void prune() {
+    auto cutoff = std::filesystem::file_time_type::clock::now() - MAX_AGE;
+
+    std::error_code ec;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(directory, ec)) {
+      std::error_code entryError;
+      if (entry.last_write_time(entryError) < cutoff && !entryError)
+        std::filesystem::remove(entry.path(), entryError);
+    }
+  }
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "hack/AssemblyResult.hpp"
+
+// Process-wide index of live assembler results by content hash, so a
+// session that opens a file another session already assembled reuses that
+// result. Entries are weak: a result lives as long as some session's
+// HackAssembler holds it, and each session still counts it against its own
+// memory budget.
+class ResultPool {
+public:
+  std::shared_ptr<const AssemblyResult> find(uint64_t contentHash) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = byContent.find(contentHash);
+    if (it == byContent.end())
+      return nullptr;
+
+    auto result = it->second.lock();
+    if (result == nullptr)
+      byContent.erase(it);
+    return result;
+  }
+
+  void add(uint64_t contentHash,
+           const std::shared_ptr<const AssemblyResult> &result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    byContent[contentHash] = result;
+
+    // Expired entries are only dropped lazily, so sweep once the map has
+    // doubled since the last sweep
+    if (byContent.size() >= sweepAt) {
+      std::erase_if(byContent,
+                    [](const auto &entry) { return entry.second.expired(); });
+      sweepAt = std::max<size_t>(MIN_SWEEP, byContent.size() * 2);
+    }
+  }
+
+private:
+  static constexpr size_t MIN_SWEEP = 256;
+
+  std::mutex mutex;
+  std::unordered_map<uint64_t, std::weak_ptr<const AssemblyResult>> byContent;
+  size_t sweepAt = MIN_SWEEP;
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "hack/AssembledOutputEngine.hpp"
+#include "hack/Emulator.hpp"
+#include "hack/HackAssembler.hpp"
+#include "hack/PredefinedSymbols.hpp"
+#include "lib/json_writer.hpp"
+#include "lsp/params.hpp"
+#include "lsp/responses.hpp"
+
+// hack/run: executes a document's machine code from a reset CPU for at most
+// maxCycles instructions and reports the registers, R0-R15 and the watched
+// symbols. Watched values are kept until the document changes so hovering a
+// symbol shows what the last run left in its RAM word.
+//
+// Runs go to the request workers like hovers: prepare() encodes the program
+// and takes the result on the message thread, and the returned job runs the
+// emulator from those alone.
+class RunEngine {
+public:
+  // Watched symbol -> value its RAM word held when the run stopped
+  using Watches = std::unordered_map<std::string, int16_t>;
+  using Job = std::function<lsp::RawResult()>;
+
+  RunEngine(AssembledOutputEngine &_assembledOutputEngine,
+            HackAssembler &_hackAssembler)
+      : assembledOutputEngine(_assembledOutputEngine),
+        hackAssembler(_hackAssembler) {}
+
+  Job prepare(const lsp::RunParams &params) {
+    const std::string &uri = params.textDocument.uri;
+
+    uint64_t generation;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      generation = generations[uri];
+    }
+
+    return [this, uri, generation,
+            words = assembledOutputEngine.program(uri).words,
+            result = hackAssembler.getResult(uri),
+            maxCycles = std::min(params.maxCycles, MAX_CYCLES),
+            watch = params.watch] {
+      return run(uri, generation, words, result.get(), maxCycles, watch);
+    };
+  }
+
+  // Watched values of the last run of the current text, or nullptr. The
+  // map is replaced rather than updated, so it may be read on any thread.
+  std::shared_ptr<const Watches> lastRun(const std::string &uri) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = uriToWatches.find(uri);
+    if (it == uriToWatches.end())
+      return nullptr;
+    return it->second;
+  }
+
+  // Called when the document changes or closes; runs still going for the
+  // old text then keep their watches to themselves
+  void remove(const std::string &uri) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uriToWatches.erase(uri);
+    generations[uri]++;
+  }
+
+private:
+  // Holds a worker for the whole run; a few seconds at most
+  static constexpr uint64_t MAX_CYCLES = 50'000'000;
+
+  AssembledOutputEngine &assembledOutputEngine;
+  HackAssembler &hackAssembler;
+
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, std::shared_ptr<const Watches>>
+      uriToWatches;
+  std::unordered_map<std::string, uint64_t> generations; // bumped by remove
+
+  lsp::RawResult run(const std::string &uri, uint64_t generation,
+                     const std::vector<uint16_t> &words,
+                     const AssemblyResult *result, uint64_t maxCycles,
+                     const std::vector<std::string> &watch) {
+    hack::Emulator emulator(words);
+    auto state = emulator.run(maxCycles);
+
+    Watches watched;
+
+    std::string json;
+    json += R"({"cycles":)";
+    json_writer::appendInt(json, static_cast<int64_t>(state.cycles));
+    json += R"(,"halted":)";
+    json += state.halted ? "true" : "false";
+    json += R"(,"pc":)";
+    json_writer::appendInt(json, state.pc);
+    json += R"(,"a":)";
+    json_writer::appendInt(json, static_cast<int16_t>(state.a));
+    json += R"(,"d":)";
+    json_writer::appendInt(json, static_cast<int16_t>(state.d));
+
+    json += R"(,"registers":[)";
+    for (uint16_t r = 0; r < 16; r++) {
+      if (r > 0)
+        json += ',';
+      json_writer::appendInt(json, static_cast<int16_t>(emulator.memory(r)));
+    }
+
+    json += R"(],"watches":{)";
+    bool first = true;
+    for (const auto &name : watch) {
+      if (!first)
+        json += ',';
+      first = false;
+
+      json_writer::appendString(json, name);
+      json += ':';
+
+      auto address = hack::predefinedValue(name);
+      if (!address && result != nullptr)
+        address = result->value(name);
+      if (!address) {
+        json += "null";
+        continue;
+      }
+
+      int16_t value = static_cast<int16_t>(
+          emulator.memory(static_cast<uint16_t>(*address)));
+      json_writer::appendInt(json, value);
+      watched[name] = value;
+    }
+    json += "}}";
+
+    auto shared = std::make_shared<const Watches>(std::move(watched));
+    std::lock_guard<std::mutex> lock(mutex);
+    if (generations[uri] == generation)
+      uriToWatches[uri] = std::move(shared);
+    return lsp::RawResult{std::move(json)};
+  }
+};
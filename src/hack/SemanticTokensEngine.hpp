@@ -0,0 +1,457 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "core/handlers/DocumentsHandler.hpp"
+#include "core/structures/TextDocument.hpp"
+#include "hack/HackSyntax.hpp"
+#include "lib/json_writer.hpp"
+#include "lsp/params.hpp"
+#include "lsp/responses.hpp"
+
+// Semantic tokens with a per-line cache. Lines are only re-tokenized after
+// TextDocument::applyChanges reports them as touched; everything else is
+// re-encoded from the cache.
+class SemanticTokensEngine {
+public:
+  // Order must match protocol::serverDetails::SEMANTIC_TOKEN_TYPES
+  enum TokenType : uint32_t {
+    Label,
+    Symbol,
+    Constant,
+    Dest,
+    Comp,
+    Jump,
+    Comment,
+  };
+
+  // Bits match protocol::serverDetails::SEMANTIC_TOKEN_MODIFIERS
+  enum TokenModifier : uint32_t {
+    Declaration = 1 << 0,
+    DefaultLibrary = 1 << 1,
+  };
+
+  SemanticTokensEngine(DocumentsHandler &_documentsHandler)
+      : documentsHandler(_documentsHandler) {}
+
+  lsp::RawResult full(lsp::SemanticTokensParams &params) {
+    auto &document = uriToTokens[params.textDocument.uri];
+    auto snapshot = documentsHandler.snapshot(params.textDocument.uri);
+
+    document.data = encode(document, snapshot->text, 0, INT_MAX,
+                           &document.lineStarts);
+    document.resultId = std::to_string(nextResultId++);
+    document.changed.reset();
+
+    return serialize(document.resultId, document.data);
+  }
+
+  lsp::RawResult range(lsp::SemanticTokensRangeParams &params) {
+    auto &document = uriToTokens[params.textDocument.uri];
+    auto snapshot = documentsHandler.snapshot(params.textDocument.uri);
+
+    auto data = encode(document, snapshot->text, params.range.start.line,
+                       params.range.end.line);
+
+    return serialize(std::nullopt, data);
+  }
+
+  // Sends only the span of the encoded array that differs from the previous
+  // result; falls back to a full result for unknown result ids. Only the
+  // lines changed since that result are re-encoded and spliced into it
+  lsp::RawResult delta(lsp::SemanticTokensDeltaParams &params) {
+    auto it = uriToTokens.find(params.textDocument.uri);
+    if (it == uriToTokens.end() ||
+        it->second.resultId != params.previousResultId) {
+      lsp::SemanticTokensParams fullParams{params.textDocument};
+      return full(fullParams);
+    }
+
+    auto &document = it->second;
+    auto snapshot = documentsHandler.snapshot(params.textDocument.uri);
+    const auto &text = snapshot->text;
+
+    std::optional<Edit> edit;
+    if (document.changed) {
+      edit = spliceChanged(document, text);
+      if (!edit)
+        edit = reencode(document, text);
+    }
+    document.changed.reset();
+    document.resultId = std::to_string(nextResultId++);
+
+    std::string json;
+    json += R"({"resultId":)";
+    json_writer::appendString(json, document.resultId);
+    json += R"(,"edits":[)";
+
+    if (edit && (edit->deleteCount != 0 || !edit->data.empty())) {
+      json += R"({"start":)";
+      json_writer::appendInt(json, static_cast<int64_t>(edit->start));
+      json += R"(,"deleteCount":)";
+      json_writer::appendInt(json, static_cast<int64_t>(edit->deleteCount));
+      json += R"(,"data":)";
+      json_writer::appendIntArray(json, edit->data);
+      json += '}';
+    }
+
+    json += "]}";
+    return lsp::RawResult{std::move(json)};
+  }
+
+  // Keeps cached lines aligned with the document: touched lines are dropped
+  // and replaced by invalid entries, untouched lines keep their tokens
+  void applySplices(const std::string &uri,
+                    const std::vector<LineSplice> &splices) {
+    auto it = uriToTokens.find(uri);
+    if (it == uriToTokens.end())
+      return;
+
+    auto &document = it->second;
+    auto &lines = document.lines;
+    for (const auto &splice : splices) {
+      size_t start = std::min<size_t>(splice.startLine, lines.size());
+      size_t end = std::min<size_t>(start + splice.removedLines, lines.size());
+
+      lines.erase(lines.begin() + start, lines.begin() + end);
+      lines.insert(lines.begin() + start, splice.addedLines, LineTokens{});
+
+      if (!document.resultId.empty())
+        document.changed =
+            document.changed ? document.changed->then(splice) : splice;
+    }
+  }
+
+  void remove(const std::string &uri) { uriToTokens.erase(uri); }
+
+private:
+  struct Token {
+    uint32_t start; // UTF-16 columns
+    uint32_t length;
+    uint32_t type;
+    uint32_t modifiers;
+  };
+
+  struct LineTokens {
+    bool valid = false;
+    std::vector<Token> tokens;
+  };
+
+  struct DocumentTokens {
+    std::vector<LineTokens> lines;
+    std::string resultId;
+    std::vector<uint32_t> data; // last result, for deltas
+    // Index into data of each line's first token, then data.size()
+    std::vector<size_t> lineStarts;
+    // The lines of data's text replaced since, if any
+    std::optional<LineSplice> changed;
+  };
+
+  // One semantic tokens edit: data replaces deleteCount numbers at start
+  struct Edit {
+    size_t start;
+    size_t deleteCount;
+    std::vector<uint32_t> data;
+  };
+
+  static constexpr size_t TOKEN_SIZE = 5; // numbers per encoded token
+
+  DocumentsHandler &documentsHandler;
+  std::unordered_map<std::string, DocumentTokens> uriToTokens;
+  uint64_t nextResultId = 1;
+
+  // Relative (LSP) encoding of lines [first, last], tokenizing only lines
+  // whose cache entry is invalid. lineStarts, if given, gets where each
+  // line's tokens start in the result
+  std::vector<uint32_t> encode(DocumentTokens &document,
+                               const std::string &text, int first, int last,
+                               std::vector<size_t> *lineStarts = nullptr) {
+    std::vector<uint32_t> data;
+    auto &lines = document.lines;
+
+    int lineCount = 0;
+    int previousLine = 0;
+    uint32_t previousStart = 0;
+    if (lineStarts)
+      lineStarts->clear();
+
+    hack::forEachLine(text, [&](int line, std::string_view lineText) {
+      lineCount = line + 1;
+      if (static_cast<size_t>(line) >= lines.size())
+        lines.emplace_back();
+
+      if (line < first)
+        return true;
+      if (line > last)
+        return false;
+
+      if (lineStarts)
+        lineStarts->push_back(data.size());
+      encodeLine(lines[line], line, lineText, previousLine, previousStart,
+                 data);
+      return true;
+    });
+    if (lineStarts)
+      lineStarts->push_back(data.size());
+
+    // Only a walk over the whole document knows the real line count
+    if (last == INT_MAX && lines.size() > static_cast<size_t>(lineCount))
+      lines.resize(lineCount);
+
+    return data;
+  }
+
+  // Appends the tokens of one line, tokenizing it if its cache entry is
+  // invalid, relative to the token at previousLine and previousStart
+  static void encodeLine(LineTokens &cached, int line,
+                         std::string_view lineText, int &previousLine,
+                         uint32_t &previousStart, std::vector<uint32_t> &data) {
+    if (!cached.valid) {
+      cached.tokens = tokenize(lineText);
+      cached.valid = true;
+    }
+
+    for (const auto &token : cached.tokens) {
+      uint32_t deltaLine = static_cast<uint32_t>(line - previousLine);
+      uint32_t deltaStart =
+          deltaLine == 0 ? token.start - previousStart : token.start;
+
+      data.insert(data.end(), {deltaLine, deltaStart, token.length, token.type,
+                               token.modifiers});
+
+      previousLine = line;
+      previousStart = token.start;
+    }
+  }
+
+  // Re-encodes the lines document.changed covers and splices them into
+  // document.data. Lines before them encode as they did; of the lines after
+  // them only the first token changes, as it is relative to the last token
+  // before it. nullopt if the cache does not line up with the text.
+  std::optional<Edit> spliceChanged(DocumentTokens &document,
+                                    std::string_view text) {
+    auto &lines = document.lines;
+    auto &starts = document.lineStarts;
+    const LineSplice &span = *document.changed;
+
+    size_t first = static_cast<size_t>(span.startLine);
+    size_t removed = static_cast<size_t>(span.removedLines);
+    size_t added = static_cast<size_t>(span.addedLines);
+    size_t oldLineCount = starts.empty() ? 0 : starts.size() - 1;
+    size_t lineCount =
+        static_cast<size_t>(std::count(text.begin(), text.end(), '\n')) + 1;
+    if (first + removed > oldLineCount ||
+        lineCount != oldLineCount - removed + added ||
+        lines.size() != lineCount)
+      return std::nullopt;
+
+    // The last token before the change, on a line with its starts entry
+    // below the next one
+    int previousLine = 0;
+    uint32_t previousStart = 0;
+    size_t spanStart = starts[first];
+    if (spanStart > 0) {
+      size_t line = static_cast<size_t>(
+          std::upper_bound(starts.begin(), starts.begin() + first + 1,
+                           spanStart - TOKEN_SIZE) -
+          starts.begin() - 1);
+      if (!lines[line].valid || lines[line].tokens.empty())
+        return std::nullopt;
+      previousLine = static_cast<int>(line);
+      previousStart = lines[line].tokens.back().start;
+    }
+
+    std::vector<uint32_t> encoded;
+    std::vector<size_t> addedStarts;
+    if (added > 0) {
+      size_t offset = 0;
+      for (size_t line = 0; line < first; line++) {
+        offset = text.find('\n', offset) + 1;
+      }
+
+      hack::forEachLine(text.substr(offset), [&](int i, std::string_view line) {
+        if (static_cast<size_t>(i) == added)
+          return false;
+        int number = static_cast<int>(first) + i;
+        addedStarts.push_back(spanStart + encoded.size());
+        encodeLine(lines[number], number, line, previousLine, previousStart,
+                   encoded);
+        return true;
+      });
+    }
+    size_t addedSize = encoded.size();
+
+    size_t tail = starts[first + removed]; // first token after the change
+    size_t deleteCount = tail - spanStart;
+    if (tail < document.data.size()) {
+      size_t oldLine = static_cast<size_t>(
+          std::upper_bound(starts.begin() + first + removed, starts.end(),
+                           tail) -
+          starts.begin() - 1);
+      const auto &cached = lines[oldLine + added - removed];
+      if (!cached.valid || cached.tokens.empty())
+        return std::nullopt;
+
+      const Token &token = cached.tokens.front();
+      uint32_t deltaLine =
+          static_cast<uint32_t>(oldLine + added - removed) -
+          static_cast<uint32_t>(previousLine);
+      encoded.insert(encoded.end(), {deltaLine, token.start, token.length,
+                                     token.type, token.modifiers});
+      deleteCount += TOKEN_SIZE;
+    }
+
+    // Lines after the change moved by the size difference
+    std::vector<size_t> newStarts;
+    newStarts.reserve(lineCount + 1);
+    newStarts.insert(newStarts.end(), starts.begin(), starts.begin() + first);
+    newStarts.insert(newStarts.end(), addedStarts.begin(), addedStarts.end());
+    for (size_t i = first + removed; i < starts.size(); i++) {
+      newStarts.push_back(starts[i] - tail + spanStart + addedSize);
+    }
+    starts = std::move(newStarts);
+
+    auto &data = document.data;
+    Edit edit = trim(data, spanStart, deleteCount, encoded);
+    data.erase(data.begin() + spanStart,
+               data.begin() + spanStart + deleteCount);
+    data.insert(data.begin() + spanStart, encoded.begin(), encoded.end());
+    return edit;
+  }
+
+  // Re-encodes the whole document and diffs it with the previous result
+  Edit reencode(DocumentTokens &document, const std::string &text) {
+    auto previous = std::move(document.data);
+    document.data = encode(document, text, 0, INT_MAX, &document.lineStarts);
+    return trim(previous, 0, previous.size(), document.data);
+  }
+
+  // The edit replacing deleteCount numbers of data at start with
+  // replacement, without the numbers both begin or end with
+  static Edit trim(const std::vector<uint32_t> &data, size_t start,
+                   size_t deleteCount, std::span<const uint32_t> replacement) {
+    size_t prefix = 0;
+    size_t maxPrefix = std::min(deleteCount, replacement.size());
+    while (prefix < maxPrefix && data[start + prefix] == replacement[prefix])
+      prefix++;
+
+    size_t suffix = 0;
+    size_t maxSuffix = maxPrefix - prefix;
+    while (suffix < maxSuffix &&
+           data[start + deleteCount - 1 - suffix] ==
+               replacement[replacement.size() - 1 - suffix])
+      suffix++;
+
+    auto kept = replacement.subspan(prefix,
+                                    replacement.size() - prefix - suffix);
+    return {start + prefix, deleteCount - prefix - suffix,
+            std::vector<uint32_t>(kept.begin(), kept.end())};
+  }
+
+  static std::vector<Token> tokenize(std::string_view lineText) {
+    std::vector<Token> tokens;
+
+    auto push = [&](size_t start, size_t end, uint32_t type,
+                    uint32_t modifiers = 0) {
+      if (end <= start)
+        return;
+      int startColumn = hack::utf16Column(lineText, start);
+      int endColumn = hack::utf16Column(lineText, end);
+      tokens.push_back({static_cast<uint32_t>(startColumn),
+                        static_cast<uint32_t>(endColumn - startColumn), type,
+                        modifiers});
+    };
+
+    std::string_view code = hack::stripComment(lineText);
+
+    size_t begin = code.find_first_not_of(" \t");
+    size_t finish = code.find_last_not_of(" \t");
+
+    if (begin != std::string_view::npos) {
+      char first = code[begin];
+
+      if (first == '(') {
+        size_t end = begin + 1;
+        while (end < code.size() && hack::isSymbolChar(code[end]))
+          end++;
+        push(begin + 1, end, Label, Declaration);
+
+      } else if (first == '@') {
+        size_t end = begin + 1;
+        while (end < code.size() && hack::isSymbolChar(code[end]))
+          end++;
+
+        std::string_view value = code.substr(begin + 1, end - begin - 1);
+        if (!value.empty() &&
+            std::isdigit(static_cast<unsigned char>(value[0])))
+          push(begin, end, Constant);
+        else
+          push(begin, end, Symbol,
+               hack::isPredefinedSymbol(value) ? uint32_t(DefaultLibrary) : 0);
+
+      } else {
+        // C-instruction: dest=comp;jump with optional dest and jump
+        size_t end = finish + 1;
+        size_t equals = code.find('=', begin);
+        size_t semicolon = code.find(';', begin);
+        if (semicolon != std::string_view::npos && semicolon >= end)
+          semicolon = std::string_view::npos;
+
+        size_t compStart = begin;
+        if (equals != std::string_view::npos && equals < end &&
+            (semicolon == std::string_view::npos || equals < semicolon)) {
+          pushTrimmed(code, begin, equals, Dest, push);
+          compStart = equals + 1;
+        }
+
+        size_t compEnd = semicolon == std::string_view::npos ? end : semicolon;
+        pushTrimmed(code, compStart, compEnd, Comp, push);
+
+        if (semicolon != std::string_view::npos)
+          pushTrimmed(code, semicolon + 1, end, Jump, push);
+      }
+    }
+
+    if (code.size() < lineText.size())
+      push(code.size(), lineText.size(), Comment);
+
+    return tokens;
+  }
+
+  template <typename Push>
+  static void pushTrimmed(std::string_view code, size_t start, size_t end,
+                          uint32_t type, Push &push) {
+    while (start < end && (code[start] == ' ' || code[start] == '\t'))
+      start++;
+    while (end > start && (code[end - 1] == ' ' || code[end - 1] == '\t'))
+      end--;
+    push(start, end, type);
+  }
+
+  static lsp::RawResult serialize(const std::optional<std::string> &resultId,
+                                  const std::vector<uint32_t> &data) {
+    std::string json;
+    json.reserve(data.size() * 3 + 32);
+
+    json += '{';
+    if (resultId) {
+      json += R"("resultId":)";
+      json_writer::appendString(json, *resultId);
+      json += ',';
+    }
+    json += R"("data":)";
+    json_writer::appendIntArray(json, data);
+    json += '}';
+
+    return lsp::RawResult{std::move(json)};
+  }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "hack/ResultPool.hpp"
+#include "hack/SymbolIndex.hpp"
+#include "hack/WorkspaceIndexer.hpp"
+
+// On-disk symbols of one workspace root and the indexer that keeps them
+// current. Sessions layer their open documents on top of `files`.
+struct SharedWorkspace {
+  SymbolIndex files;
+  WorkspaceIndexer indexer{files};
+};
+
+// State shared by every session of one server process: with --stdio there
+// is a single session, with --socket/--port each editor connection is one.
+// Sessions that open the same root share its index, so only the first one
+// pays for the initial scan.
+class SharedState {
+public:
+  ResultPool results;
+
+  std::shared_ptr<SharedWorkspace> workspace(const std::string &rootUri) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto &entry = workspaces[rootUri];
+    if (auto existing = entry.lock())
+      return existing;
+
+    auto created = std::make_shared<SharedWorkspace>();
+    created->indexer.start(rootUri);
+    entry = created;
+    return created;
+  }
+
+private:
+  std::mutex mutex;
+  // Weak, so a root is dropped with the last session that uses it
+  std::unordered_map<std::string, std::weak_ptr<SharedWorkspace>> workspaces;
+};
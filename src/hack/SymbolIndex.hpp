@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hack/AssemblyResult.hpp"
+#include "hack/HackSyntax.hpp"
+#include "lib/fuzzy.hpp"
+#include "lib/uri.hpp"
+#include "lsp/types.hpp"
+
+struct SymbolOccurrence {
+  uint32_t symbol; // index into DocumentSymbols::names
+  int line;
+  int start; // UTF-16 columns of the name, without '@' or parentheses
+  int end;
+  bool declaration;
+};
+
+// Every label declaration and @symbol reference of one document, built in a
+// single pass over the text
+struct DocumentSymbols {
+  std::vector<std::string> names;
+  std::unordered_map<std::string, uint32_t> ids;
+  std::vector<SymbolOccurrence> occurrences;    // in document order
+  std::vector<std::vector<uint32_t>> byName;    // occurrence indices per symbol
+  std::vector<uint64_t> masks;                  // fuzzy::charMask of each name
+  std::array<std::vector<uint32_t>, 64> byChar; // names per charMask bit
+
+  static DocumentSymbols build(std::string_view text) {
+    DocumentSymbols symbols;
+
+    hack::forEachLine(text, [&](int line, std::string_view lineText) {
+      std::string_view code = hack::stripComment(lineText);
+
+      size_t i = code.find_first_not_of(" \t");
+      if (i == std::string_view::npos)
+        return;
+
+      bool declaration = code[i] == '(';
+      if (!declaration && code[i] != '@')
+        return;
+
+      size_t start = i + 1;
+      size_t end = start;
+      while (end < code.size() && hack::isSymbolChar(code[end]))
+        end++;
+
+      if (end == start || !hack::isSymbolStart(code[start]))
+        return;
+
+      // Built-ins live in hack::PREDEFINED_SYMBOLS, not per document
+      if (hack::isPredefinedSymbol(code.substr(start, end - start)))
+        return;
+
+      symbols.add(std::string(code.substr(start, end - start)), line,
+                  hack::utf16Column(lineText, start),
+                  hack::utf16Column(lineText, end), declaration);
+    });
+
+    return symbols;
+  }
+
+  // The occurrences a disk cache entry carries, without reading the text
+  static DocumentSymbols fromResult(const AssemblyResult &result) {
+    DocumentSymbols symbols;
+    for (size_t i = 0; i < result.occurrenceCount(); i++) {
+      auto occurrence = result.occurrence(i);
+      symbols.add(std::string(occurrence.name), occurrence.line,
+                  occurrence.start, occurrence.end, occurrence.declaration);
+    }
+    return symbols;
+  }
+
+  // The occurrences in the form AssemblyResult stores them
+  std::vector<AssemblyResult::Occurrence> records() const {
+    std::vector<AssemblyResult::Occurrence> records;
+    records.reserve(occurrences.size());
+    for (const auto &occurrence : occurrences) {
+      records.push_back({names[occurrence.symbol], occurrence.line,
+                         occurrence.start, occurrence.end,
+                         occurrence.declaration});
+    }
+    return records;
+  }
+
+  const SymbolOccurrence *at(const lsp::Position &position) const {
+    auto it = std::lower_bound(
+        occurrences.begin(), occurrences.end(), position,
+        [](const SymbolOccurrence &occurrence, const lsp::Position &pos) {
+          return occurrence.line < pos.line ||
+                 (occurrence.line == pos.line &&
+                  occurrence.end < pos.character);
+        });
+
+    if (it == occurrences.end() || it->line != position.line ||
+        it->start > position.character)
+      return nullptr;
+
+    return &*it;
+  }
+
+  const uint32_t *find(const std::string &name) const {
+    auto it = ids.find(name);
+    return it == ids.end() ? nullptr : &it->second;
+  }
+
+  bool isLabel(uint32_t symbol) const {
+    for (uint32_t index : byName[symbol]) {
+      if (occurrences[index].declaration)
+        return true;
+    }
+    return false;
+  }
+
+  // Calls fn(symbol) for every name holding all characters of queryMask.
+  // Only the names of the query's rarest character are visited.
+  template <typename Fn>
+  void forEachCandidate(uint64_t queryMask, Fn fn) const {
+    const std::vector<uint32_t> *rarest = nullptr;
+    for (uint64_t bits = queryMask; bits != 0; bits &= bits - 1) {
+      const auto &ids = byChar[std::countr_zero(bits)];
+      if (rarest == nullptr || ids.size() < rarest->size())
+        rarest = &ids;
+    }
+
+    if (rarest == nullptr) {
+      for (uint32_t id = 0; id < names.size(); id++)
+        fn(id);
+      return;
+    }
+
+    for (uint32_t id : *rarest) {
+      if ((masks[id] & queryMask) == queryMask)
+        fn(id);
+    }
+  }
+
+  // The label declaration, or the first reference for variables
+  const SymbolOccurrence &definition(uint32_t symbol) const {
+    for (uint32_t index : byName[symbol]) {
+      if (occurrences[index].declaration)
+        return occurrences[index];
+    }
+    return occurrences[byName[symbol].front()];
+  }
+
+private:
+  void add(std::string name, int line, int start, int end, bool declaration) {
+    auto [it, inserted] =
+        ids.emplace(std::move(name), static_cast<uint32_t>(names.size()));
+    if (inserted) {
+      names.push_back(it->first);
+      byName.emplace_back();
+      uint64_t mask = fuzzy::charMask(it->first);
+      masks.push_back(mask);
+      for (uint64_t bits = mask; bits != 0; bits &= bits - 1)
+        byChar[std::countr_zero(bits)].push_back(it->second);
+    }
+
+    byName[it->second].push_back(static_cast<uint32_t>(occurrences.size()));
+    occurrences.push_back({it->second, line, start, end, declaration});
+  }
+};
+
+// Per-URI occurrence indexes for open documents and for workspace files found
+// by the WorkspaceIndexer. Entries are immutable and swapped under a short
+// lock, so readers never wait on a rebuild.
+//
+// A session's index can be layered over a shared index of on-disk files:
+// lookups fall through to it for URIs the session does not have open.
+//
+// Entries are keyed by uri::normalize(), as clients and the WorkspaceIndexer
+// may encode the same file's URI differently, but keep the URI they were
+// indexed under: an open document's locations use the client's own.
+class SymbolIndex {
+public:
+  void layerOver(const SymbolIndex *_files) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    files = _files;
+    changes++;
+  }
+
+  // Open documents always take precedence over their on-disk copy
+  void index(const std::string &uri, const std::string &text) {
+    index(uri, DocumentSymbols::build(text));
+  }
+
+  void index(const std::string &uri, DocumentSymbols built) {
+    auto symbols = std::make_shared<const DocumentSymbols>(std::move(built));
+
+    std::string key = uri::normalize(uri);
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    uriToSymbols[std::move(key)] = Entry{std::move(symbols), uri, true};
+    changes++;
+  }
+
+  void remove(const std::string &uri) {
+    std::string key = uri::normalize(uri);
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    changes += uriToSymbols.erase(key);
+  }
+
+  void indexFile(const std::string &uri,
+                 std::shared_ptr<const DocumentSymbols> symbols) {
+    std::string key = uri::normalize(uri);
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto &entry = uriToSymbols[key];
+    if (!entry.open) {
+      entry.symbols = std::move(symbols);
+      entry.uri = uri;
+      changes++;
+    }
+  }
+
+  void removeFile(const std::string &uri) {
+    std::string key = uri::normalize(uri);
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = uriToSymbols.find(key);
+    if (it != uriToSymbols.end() && !it->second.open) {
+      uriToSymbols.erase(it);
+      changes++;
+    }
+  }
+
+  std::shared_ptr<const DocumentSymbols> get(const std::string &uri) const {
+    std::string key = uri::normalize(uri);
+
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return find(key);
+  }
+
+  // Grows with every change to this index or the one it is layered over, so
+  // a snapshot() can be kept until it does
+  uint64_t generation() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return changes + (files ? files->generation() : 0);
+  }
+
+  // Every indexed document, open or not, as of this call
+  std::vector<std::pair<std::string, std::shared_ptr<const DocumentSymbols>>>
+  snapshot() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    std::vector<std::pair<std::string, std::shared_ptr<const DocumentSymbols>>>
+        documents;
+    documents.reserve(uriToSymbols.size());
+
+    for (const auto &[key, entry] : uriToSymbols) {
+      if (entry.symbols != nullptr)
+        documents.emplace_back(entry.uri, entry.symbols);
+    }
+
+    if (files != nullptr) {
+      std::shared_lock<std::shared_mutex> filesLock(files->mutex);
+      for (const auto &[key, entry] : files->uriToSymbols) {
+        if (entry.symbols != nullptr && !uriToSymbols.contains(key))
+          documents.emplace_back(entry.uri, entry.symbols);
+      }
+    }
+    return documents;
+  }
+
+private:
+  struct Entry {
+    std::shared_ptr<const DocumentSymbols> symbols;
+    std::string uri; // as indexed, for locations
+    bool open = false;
+  };
+
+  // The entry under a normalized key here or in the index below
+  std::shared_ptr<const DocumentSymbols> find(const std::string &key) const {
+    auto it = uriToSymbols.find(key);
+    if (it != uriToSymbols.end() && it->second.symbols != nullptr)
+      return it->second.symbols;
+
+    if (files == nullptr)
+      return nullptr;
+    std::shared_lock<std::shared_mutex> lock(files->mutex);
+    return files->find(key);
+  }
+
+  mutable std::shared_mutex mutex;
+  std::unordered_map<std::string, Entry> uriToSymbols;
+  const SymbolIndex *files = nullptr;
+  uint64_t changes = 0;
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "hack/SymbolIndex.hpp"
+#include "lib/MappedFile.hpp"
+#include "lib/uri.hpp"
+#include "lsp/params.hpp"
+
+// Indexes every .asm file under the workspace root on a background thread,
+// then keeps the index current from workspace/didChangeWatchedFiles events.
+// Results are published into the SymbolIndex one file at a time, so
+// interactive requests are never blocked behind indexing.
+class WorkspaceIndexer {
+public:
+  WorkspaceIndexer(SymbolIndex &_symbolIndex) : symbolIndex(_symbolIndex) {}
+
+  ~WorkspaceIndexer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeUp.notify_one();
+
+    if (worker.joinable())
+      worker.join();
+  }
+
+  WorkspaceIndexer(const WorkspaceIndexer &) = delete;
+  WorkspaceIndexer &operator=(const WorkspaceIndexer &) = delete;
+
+  void start(const std::string &rootUri) {
+    auto path = uri::toPath(rootUri);
+    if (!path || worker.joinable())
+      return;
+
+    std::error_code ec;
+    if (!std::filesystem::is_directory(*path, ec))
+      return;
+
+    rootPath = std::filesystem::path(*path).lexically_normal();
+    worker = std::thread(&WorkspaceIndexer::run, this);
+  }
+
+  void onFilesChanged(const std::vector<lsp::FileEvent> &events) {
+    if (!worker.joinable())
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.insert(pending.end(), events.begin(), events.end());
+    }
+    wakeUp.notify_one();
+  }
+
+  // Re-reads a file from disk, e.g. after its editor buffer was closed
+  void refresh(const std::string &uri) {
+    onFilesChanged({{uri, lsp::FileEvent::FileChangeType::Changed}});
+  }
+
+private:
+  SymbolIndex &symbolIndex;
+  std::filesystem::path rootPath;
+  std::thread worker;
+
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  std::vector<lsp::FileEvent> pending;
+  std::atomic<bool> stopping = false;
+
+  void run() {
+    indexAll(collectFiles());
+
+    while (true) {
+      std::vector<lsp::FileEvent> events;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeUp.wait(lock, [&] { return stopping || !pending.empty(); });
+        if (stopping)
+          return;
+        events.swap(pending);
+      }
+
+      for (const auto &event : events) {
+        handleEvent(event);
+      }
+    }
+  }
+
+  std::vector<std::filesystem::path> collectFiles() {
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+
+    auto it = std::filesystem::recursive_directory_iterator(
+        rootPath, std::filesystem::directory_options::skip_permission_denied,
+        ec);
+
+    for (; !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      if (stopping)
+        break;
+
+      const auto &path = it->path();
+
+      // Skip hidden directories such as .git
+      if (it->is_directory(ec) && path.filename().string().starts_with(".")) {
+        it.disable_recursion_pending();
+        continue;
+      }
+
+      if (path.extension() == ".asm" && it->is_regular_file(ec))
+        files.push_back(path);
+    }
+
+    return files;
+  }
+
+  // Files are handed out through a shared counter, so a few huge files do not
+  // leave the other workers idle
+  void indexAll(const std::vector<std::filesystem::path> &files) {
+    size_t threadCount = std::min<size_t>(
+        std::max(1u, std::thread::hardware_concurrency()), files.size());
+
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> workers;
+    workers.reserve(threadCount);
+
+    for (size_t t = 0; t < threadCount; t++) {
+      workers.emplace_back([&] {
+        for (size_t i = next++; i < files.size() && !stopping; i = next++) {
+          indexPath(files[i]);
+        }
+      });
+    }
+
+    for (auto &thread : workers) {
+      thread.join();
+    }
+  }
+
+  void indexPath(const std::filesystem::path &path) {
+    MappedFile file(path.string());
+    if (!file.isOpen())
+      return;
+
+    auto symbols = std::make_shared<const DocumentSymbols>(
+        DocumentSymbols::build(file.view()));
+    symbolIndex.indexFile(uri::fromPath(path.string()), std::move(symbols));
+  }
+
+  void handleEvent(const lsp::FileEvent &event) {
+    auto path = uri::toPath(event.uri);
+    if (!path)
+      return;
+
+    auto filePath = std::filesystem::path(*path).lexically_normal();
+    auto relative = filePath.lexically_relative(rootPath);
+    bool inWorkspace = !relative.empty() && *relative.begin() != "..";
+
+    std::error_code ec;
+    if (event.type == lsp::FileEvent::FileChangeType::Deleted || !inWorkspace ||
+        filePath.extension() != ".asm" ||
+        !std::filesystem::is_regular_file(filePath, ec)) {
+      symbolIndex.removeFile(uri::fromPath(filePath.string()));
+      return;
+    }
+
+    indexPath(filePath);
+  }
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hack/SymbolIndex.hpp"
+#include "lib/fuzzy.hpp"
+#include "lsp/params.hpp"
+#include "lsp/responses.hpp"
+
+class WorkspaceSymbolEngine {
+public:
+  WorkspaceSymbolEngine(SymbolIndex &_symbolIndex)
+      : symbolIndex(_symbolIndex) {}
+
+  // Fuzzy search over every label and variable of every indexed document.
+  // Each document lists its names per character at index time, so a query
+  // only visits names holding its rarest character, checks their char
+  // masks and scores the survivors. The snapshot of documents is kept until
+  // the index changes.
+  lsp::WorkspaceSymbolResult symbols(lsp::WorkspaceSymbolParams &params) {
+
+    const std::string &query = params.query;
+    const uint64_t queryMask = fuzzy::charMask(query);
+
+    uint64_t generation = symbolIndex.generation();
+    if (generation != documentsGeneration) {
+      documents = symbolIndex.snapshot();
+      documentsGeneration = generation;
+    }
+
+    struct Candidate {
+      int score;
+      uint32_t document;
+      uint32_t symbol;
+    };
+    std::vector<Candidate> candidates;
+
+    for (uint32_t d = 0; d < documents.size(); d++) {
+      const auto &symbols = *documents[d].second;
+
+      symbols.forEachCandidate(queryMask, [&](uint32_t id) {
+        int score = fuzzy::score(symbols.names[id], query);
+        if (score >= 0)
+          candidates.push_back({score, d, id});
+      });
+    }
+
+    size_t limit = std::min(candidates.size(), MAX_RESULTS);
+    std::partial_sort(candidates.begin(), candidates.begin() + limit,
+                      candidates.end(),
+                      [](const Candidate &lhs, const Candidate &rhs) {
+                        return lhs.score > rhs.score;
+                      });
+
+    lsp::WorkspaceSymbolResult result;
+    result.reserve(limit);
+
+    for (size_t i = 0; i < limit; i++) {
+      const auto &[uri, symbols] = documents[candidates[i].document];
+      uint32_t id = candidates[i].symbol;
+      const auto &definition = symbols->definition(id);
+
+      result.push_back(
+          {.name = symbols->names[id],
+           .kind = symbols->isLabel(id) ? lsp::SymbolKind::Function
+                                        : lsp::SymbolKind::Variable,
+           .uri = uri,
+           .range = {{definition.line, definition.start},
+                     {definition.line, definition.end}}});
+    }
+
+    return result;
+  }
+
+private:
+  static constexpr size_t MAX_RESULTS = 256;
+
+  SymbolIndex &symbolIndex;
+
+  // symbolIndex.snapshot() as of documentsGeneration
+  std::vector<std::pair<std::string, std::shared_ptr<const DocumentSymbols>>>
+      documents;
+  std::optional<uint64_t> documentsGeneration;
+};
@@ -0,0 +1,40 @@
+#include "MappedFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return;
+  }
+
+  size = static_cast<size_t>(st.st_size);
+
+  // mmap rejects zero-length mappings, an empty file is just an empty view
+  if (size > 0) {
+    void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      ::close(fd);
+      size = 0;
+      return;
+    }
+    ::madvise(mapped, size, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(mapped);
+  }
+
+  ::close(fd);
+  opened = true;
+}
+
+MappedFile::~MappedFile() {
+  if (data != nullptr)
+    ::munmap(const_cast<char *>(data), size);
+}
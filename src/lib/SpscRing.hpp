@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread. Each side owns one counter and only reads the other's;
+// a full or empty queue waits on the other counter (a futex, not a lock).
+//
+// close() may be called from either side: push() then fails, and pop()
+// returns what is still queued before reporting the end.
+template <typename T, size_t Capacity> class SpscRing {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+public:
+  SpscRing() = default;
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  // Waits while the queue is full; returns false once it is closed
+  bool push(T value) {
+    while (true) {
+      size_t tail = written.load(std::memory_order_relaxed);
+      size_t head = read.load(std::memory_order_acquire);
+      if ((tail | head) & CLOSED)
+        return false;
+
+      if (tail - head < Capacity)
+        break;
+      read.wait(head, std::memory_order_acquire);
+    }
+
+    size_t tail = written.load(std::memory_order_relaxed);
+    slots[tail & MASK] = std::move(value);
+    written.fetch_add(1, std::memory_order_release);
+    written.notify_one();
+    return true;
+  }
+
+  // Waits while the queue is empty; nullopt once it is closed and drained
+  std::optional<T> pop() {
+    size_t head;
+    while (true) {
+      head = read.load(std::memory_order_relaxed);
+      size_t tail = written.load(std::memory_order_acquire);
+      if ((tail & ~CLOSED) != (head & ~CLOSED))
+        break;
+
+      if ((tail | head) & CLOSED)
+        return std::nullopt;
+      written.wait(tail, std::memory_order_acquire);
+    }
+
+    return take(head);
+  }
+
+  // Like pop(), but returns nullopt at once if the queue is empty
+  std::optional<T> tryPop() {
+    size_t head = read.load(std::memory_order_relaxed);
+    size_t tail = written.load(std::memory_order_acquire);
+    if ((tail & ~CLOSED) == (head & ~CLOSED))
+      return std::nullopt;
+
+    return take(head);
+  }
+
+  void close() {
+    // Setting the flag changes both counters, which wakes either side
+    written.fetch_or(CLOSED, std::memory_order_release);
+    read.fetch_or(CLOSED, std::memory_order_release);
+    written.notify_all();
+    read.notify_all();
+  }
+
+private:
+  // The top bit of each counter marks the queue closed; the rest counts
+  // the items pushed (written) and popped (read)
+  static constexpr size_t CLOSED = size_t(1) << (sizeof(size_t) * 8 - 1);
+  static constexpr size_t MASK = Capacity - 1;
+
+  // On separate cache lines so the two threads don't contend on them
+  alignas(64) std::atomic<size_t> written = 0;
+  alignas(64) std::atomic<size_t> read = 0;
+  std::array<T, Capacity> slots;
+
+  T take(size_t head) {
+    T value = std::move(slots[head & MASK]);
+    read.fetch_add(1, std::memory_order_release);
+    read.notify_one();
+    return value;
+  }
+};
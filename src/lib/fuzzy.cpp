@@ -0,0 +1,96 @@
+#include "fuzzy.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+namespace fuzzy {
+
+// Helper function to map a character to its bit in a char mask
+inline int charBit(unsigned char c) {
+  c = static_cast<unsigned char>(std::tolower(c));
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  if (c >= '0' && c <= '9')
+    return 26 + (c - '0');
+
+  switch (c) {
+  case '_':
+    return 36;
+  case '.':
+    return 37;
+  case '$':
+    return 38;
+  case ':':
+    return 39;
+  default:
+    return 40;
+  }
+}
+
+// Helper function to check whether position i starts a new word
+inline bool isWordStart(std::string_view text, size_t i) {
+  if (i == 0)
+    return true;
+
+  unsigned char prev = static_cast<unsigned char>(text[i - 1]);
+  unsigned char cur = static_cast<unsigned char>(text[i]);
+
+  if (!std::isalnum(prev))
+    return true;
+  if (std::islower(prev) && std::isupper(cur))
+    return true;
+  return std::isdigit(prev) != std::isdigit(cur);
+}
+
+uint64_t charMask(std::string_view text) {
+  uint64_t mask = 0;
+  for (unsigned char c : text) {
+    mask |= uint64_t(1) << charBit(c);
+  }
+  return mask;
+}
+
+int score(std::string_view candidate, std::string_view query) {
+  size_t qi = 0;
+  int total = 0;
+  size_t previous = 0;
+  bool matchedBefore = false;
+  bool exactCase = candidate.size() == query.size();
+
+  for (size_t i = 0; i < candidate.size() && qi < query.size(); i++) {
+    unsigned char c = static_cast<unsigned char>(candidate[i]);
+    unsigned char q = static_cast<unsigned char>(query[qi]);
+
+    if (std::tolower(c) != std::tolower(q))
+      continue;
+
+    int points = 1;
+    if (isWordStart(candidate, i))
+      points += i == 0 ? 8 : 6;
+    if (matchedBefore && previous + 1 == i)
+      points += 4;
+    if (c != q)
+      exactCase = false;
+
+    total += points;
+    previous = i;
+    matchedBefore = true;
+    qi++;
+  }
+
+  if (qi < query.size())
+    return -1;
+
+  // A full-length match means the strings are equal ignoring case
+  if (candidate.size() == query.size())
+    total += exactCase ? 200 : 150;
+  else if (matchedBefore && previous + 1 == query.size())
+    total += 50; // prefix
+
+  // Prefer shorter names among otherwise equal matches
+  int lengthPenalty = static_cast<int>(std::min<size_t>(candidate.size(), 255));
+  return total * 256 + (255 - lengthPenalty);
+}
+
+} // namespace fuzzy
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace fuzzy {
+
+/**
+ * Computes a case-insensitive bitmask of the characters present in a string.
+ * A candidate can only match a query if it contains all of the query's bits,
+ * which rejects most candidates before any scoring happens.
+ *
+ * @param text The string to summarize
+ * @return One bit per letter, digit and common symbol punctuation
+ */
+uint64_t charMask(std::string_view text);
+
+/**
+ * Scores a case-insensitive subsequence match of query within candidate.
+ * Matches at the start, after word boundaries ('_', '.', '$', ':', case
+ * changes) and consecutive runs score higher; exact and prefix matches rank
+ * above everything else.
+ *
+ * @param candidate The symbol name being ranked
+ * @param query The user's search string
+ * @return The match score, or -1 if query is not a subsequence of candidate
+ */
+int score(std::string_view candidate, std::string_view query);
+
+} // namespace fuzzy
@@ -0,0 +1,65 @@
+#include "hash.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace hash {
+
+constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t mix(uint64_t acc, uint64_t lane) {
+  acc += lane * PRIME_2;
+  acc = rotl(acc, 31);
+  return acc * PRIME_1;
+}
+
+// Final avalanche so every input bit affects every output bit
+inline uint64_t avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= PRIME_2;
+  h ^= h >> 29;
+  h *= PRIME_3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t hash64(std::string_view data, uint64_t seed) {
+  const char *p = data.data();
+  size_t remaining = data.size();
+  uint64_t h = seed + PRIME_3 + data.size();
+
+  while (remaining >= 8) {
+    uint64_t lane;
+    std::memcpy(&lane, p, sizeof(lane));
+    h = mix(h, lane);
+    p += 8;
+    remaining -= 8;
+  }
+
+  uint64_t tail = 0;
+  std::memcpy(&tail, p, remaining);
+  h = mix(h, tail);
+
+  return avalanche(h);
+}
+
+uint64_t combine(uint64_t digest, uint64_t value) {
+  return avalanche(mix(digest, value));
+}
+
+std::string toHex(uint64_t digest) {
+  constexpr const char *hex = "0123456789abcdef";
+
+  std::string out(16, '0');
+  for (int i = 15; i >= 0; i--) {
+    out[i] = hex[digest & 0xF];
+    digest >>= 4;
+  }
+  return out;
+}
+
+} // namespace hash
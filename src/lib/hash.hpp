@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace hash {
+
+/**
+ * Computes a fast, non-cryptographic 64-bit hash of a byte string, consuming
+ * eight bytes per step. Used to key results on document content.
+ *
+ * @param data The bytes to hash
+ * @param seed Optional seed to derive independent hashes
+ * @return The 64-bit digest
+ */
+uint64_t hash64(std::string_view data, uint64_t seed = 0);
+
+/**
+ * Combines a running digest with another 64-bit value.
+ *
+ * @param digest The running digest
+ * @param value The value to mix in
+ * @return The combined digest
+ */
+uint64_t combine(uint64_t digest, uint64_t value);
+
+/**
+ * Formats a digest as 16 lowercase hex digits.
+ *
+ * @param digest The digest to format
+ * @return The hex string
+ */
+std::string toHex(uint64_t digest);
+
+} // namespace hash
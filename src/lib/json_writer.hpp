@@ -0,0 +1,39 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <nlohmann/json.hpp>
+
+// Helpers for results that are written straight into a response buffer
+// instead of being built as a json tree first
+namespace json_writer {
+
+inline void appendInt(std::string &out, int64_t value) {
+  char buffer[24];
+  auto res = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, res.ptr);
+}
+
+// Appends a quoted, escaped JSON string
+inline void appendString(std::string &out, std::string_view value) {
+  out += nlohmann::json(value).dump();
+}
+
+// Appends values as a comma-separated JSON array
+template <typename Container>
+void appendIntArray(std::string &out, const Container &values) {
+  out += '[';
+  bool first = true;
+  for (auto value : values) {
+    if (!first)
+      out += ',';
+    appendInt(out, static_cast<int64_t>(value));
+    first = false;
+  }
+  out += ']';
+}
+
+} // namespace json_writer
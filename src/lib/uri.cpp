@@ -0,0 +1,68 @@
+#include "uri.hpp"
+
+#include <cctype>
+#include <string>
+
+namespace uri {
+
+// Helper function to decode a single hex digit, -1 if invalid
+inline int hexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+std::optional<std::string> toPath(const std::string &uri) {
+  constexpr const char *scheme = "file://";
+  if (uri.rfind(scheme, 0) != 0)
+    return std::nullopt;
+
+  std::string path;
+  path.reserve(uri.size());
+
+  for (size_t i = 7; i < uri.size(); i++) {
+    if (uri[i] == '%' && i + 2 < uri.size()) {
+      int hi = hexValue(uri[i + 1]);
+      int lo = hexValue(uri[i + 2]);
+      if (hi >= 0 && lo >= 0) {
+        path += static_cast<char>(hi * 16 + lo);
+        i += 2;
+        continue;
+      }
+    }
+    path += uri[i];
+  }
+
+  return path;
+}
+
+std::string fromPath(const std::string &path) {
+  constexpr const char *hex = "0123456789ABCDEF";
+
+  std::string uri = "file://";
+  uri.reserve(uri.size() + path.size());
+
+  for (unsigned char c : path) {
+    if (std::isalnum(c) || c == '/' || c == '-' || c == '.' || c == '_' ||
+        c == '~') {
+      uri += static_cast<char>(c);
+    } else {
+      uri += '%';
+      uri += hex[c >> 4];
+      uri += hex[c & 0xF];
+    }
+  }
+
+  return uri;
+}
+
+std::string normalize(const std::string &uri) {
+  auto path = toPath(uri);
+  return path ? fromPath(*path) : uri;
+}
+
+} // namespace uri
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+namespace uri {
+
+/**
+ * Converts a file:// URI to a local filesystem path, decoding percent escapes.
+ *
+ * @param uri The document URI as sent by the client
+ * @return The decoded path, or std::nullopt for non-file URIs
+ */
+std::optional<std::string> toPath(const std::string &uri);
+
+/**
+ * Converts an absolute filesystem path to a file:// URI, percent-encoding
+ * every byte outside the unreserved set (and '/').
+ *
+ * @param path The absolute filesystem path
+ * @return The encoded file:// URI
+ */
+std::string fromPath(const std::string &path);
+
+/**
+ * Re-encodes a file:// URI the way fromPath() encodes it, so a client URI
+ * ("file:///a%3A/b c.asm") and one built from a path on disk name the same
+ * file with the same string.
+ *
+ * @param uri The document URI as sent by the client
+ * @return The re-encoded URI, or uri itself for non-file URIs
+ */
+std::string normalize(const std::string &uri);
+
+} // namespace uri
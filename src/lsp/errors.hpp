@@ -17,7 +17,9 @@ enum class ErrorCode : int {
   // LSP specific error codes
   METHOD_NOT_FOUND = -32601,
   INVALID_PARAMS = -32602,
-  SERVER_NOT_INITIALIZED = -32002
+  SERVER_NOT_INITIALIZED = -32002,
+  REQUEST_FAILED = -32803,
+  REQUEST_CANCELLED = -32800
 };
 
 class Error : public std::exception {
@@ -51,6 +53,10 @@ inline const char *getErrorMessage(lsp::ErrorCode code) {
     return "Internal error";
   case lsp::ErrorCode::SERVER_NOT_INITIALIZED:
     return "Server not initialized";
+  case lsp::ErrorCode::REQUEST_FAILED:
+    return "Request failed";
+  case lsp::ErrorCode::REQUEST_CANCELLED:
+    return "Request cancelled";
   default:
     return "Unknown error";
   }
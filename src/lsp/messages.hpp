@@ -18,6 +18,7 @@ enum class Severity : int { Error = 1, Warning = 2, Information = 3, Hint = 4 };
 struct DiagnosticMessage {
   int line = 0;
   int character = 0;
+  int endCharacter = 0; // same line as `character`
   std::string message;
   Severity severity = Severity::Error;
 };
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -18,8 +20,10 @@ struct ClientInfo {
 };
 
 struct ClientCapabilities {
-  // Empty for now - can be extended if we need client capabilities in the
-  // future
+  // workspace.didChangeWatchedFiles.dynamicRegistration
+  bool watchedFilesDynamicRegistration = false;
+  // textDocument.diagnostic: the client pulls diagnostics itself
+  bool diagnosticPull = false;
 };
 
 struct InitializeParams {
@@ -68,16 +72,113 @@ struct HoverParams {
   Position position;
 };
 
+struct FileEvent {
+  enum class FileChangeType { Created = 1, Changed = 2, Deleted = 3 };
+  DocumentUri uri;
+  FileChangeType type;
+};
+
+struct DidChangeWatchedFilesParams {
+  std::vector<FileEvent> changes;
+};
+
+struct DocumentDiagnosticParams {
+  TextDocumentIdentifier textDocument;
+  std::optional<std::string> previousResultId;
+};
+
+struct WorkspaceDiagnosticParams {
+  std::unordered_map<DocumentUri, std::string> previousResultIds;
+};
+
+struct InlayHintParams {
+  TextDocumentIdentifier textDocument;
+  Range range;
+};
+
+enum class AssembledOutputFormat { Binary, Hex };
+
+// hack/assembledOutput (server extension)
+struct AssembledOutputParams {
+  TextDocumentIdentifier textDocument;
+  AssembledOutputFormat format = AssembledOutputFormat::Binary;
+  std::optional<nlohmann::json> partialResultToken;
+};
+
+// hack/run (server extension)
+struct RunParams {
+  TextDocumentIdentifier textDocument;
+  uint64_t maxCycles = 10'000'000;
+  std::vector<std::string> watch; // symbols whose RAM value is reported
+};
+
+struct FormattingOptions {
+  int tabSize = 4;
+  bool insertSpaces = true;
+};
+
+struct DocumentFormattingParams {
+  TextDocumentIdentifier textDocument;
+  FormattingOptions options;
+};
+
+struct DocumentRangeFormattingParams {
+  TextDocumentIdentifier textDocument;
+  Range range;
+  FormattingOptions options;
+};
+
+struct SemanticTokensParams {
+  TextDocumentIdentifier textDocument;
+};
+
+struct SemanticTokensRangeParams {
+  TextDocumentIdentifier textDocument;
+  Range range;
+};
+
+struct SemanticTokensDeltaParams {
+  TextDocumentIdentifier textDocument;
+  std::string previousResultId;
+};
+
+struct WorkspaceSymbolParams {
+  std::string query;
+};
+
+struct PrepareRenameParams {
+  TextDocumentIdentifier textDocument;
+  Position position;
+};
+
+struct RenameParams {
+  TextDocumentIdentifier textDocument;
+  Position position;
+  std::string newName;
+};
+
 inline void from_json(const nlohmann::json &j, lsp::ClientInfo &ci) {
   j.at("name").get_to(ci.name);
   if (j.contains("version"))
     ci.version = j.at("version").get<std::string>();
 }
 
-inline void from_json(const nlohmann::json &, lsp::ClientCapabilities &) {
-  // We don't currently use any client capabilities
-  // The client may send capabilities, but we ignore them for now
-  // This allows the server to work with any client without errors
+inline void from_json(const nlohmann::json &j, lsp::ClientCapabilities &c) {
+  // Only the capabilities we act on are read, everything else is ignored so
+  // the server works with any client without errors
+  if (j.contains("workspace") && j.at("workspace").is_object()) {
+    const auto &workspace = j.at("workspace");
+    if (workspace.contains("didChangeWatchedFiles") &&
+        workspace.at("didChangeWatchedFiles").is_object()) {
+      c.watchedFilesDynamicRegistration =
+          workspace.at("didChangeWatchedFiles")
+              .value("dynamicRegistration", false);
+    }
+  }
+
+  if (j.contains("textDocument") && j.at("textDocument").is_object()) {
+    c.diagnosticPull = j.at("textDocument").contains("diagnostic");
+  }
 }
 
 inline void from_json(const nlohmann::json &j, lsp::InitializeParams &p) {
@@ -100,6 +201,10 @@ inline void from_json(const nlohmann::json &j, lsp::InitializeParams &p) {
     p.rootUri = nullptr;
   }
 
+  if (j.contains("initializationOptions") &&
+      !j.at("initializationOptions").is_null())
+    p.initializationOptions = j.at("initializationOptions");
+
   // capabilities (only needed fields)
   p.capabilities = j.at("capabilities").get<lsp::ClientCapabilities>();
 
@@ -217,4 +322,141 @@ inline void from_json(const nlohmann::json &j, lsp::HoverParams &params) {
   j.at("position").at("character").get_to<int>(character);
   params.position = lsp::Position{line, character};
 }
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::DidChangeWatchedFilesParams &params) {
+  for (auto &change : j.at("changes")) {
+    lsp::FileEvent event;
+    change.at("uri").get_to(event.uri);
+    event.type = static_cast<lsp::FileEvent::FileChangeType>(
+        change.at("type").get<int>());
+    params.changes.push_back(std::move(event));
+  }
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::DocumentDiagnosticParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+  if (j.contains("previousResultId") && j.at("previousResultId").is_string())
+    params.previousResultId = j.at("previousResultId").get<std::string>();
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::WorkspaceDiagnosticParams &params) {
+  for (auto &previous : j.at("previousResultIds")) {
+    params.previousResultIds[previous.at("uri").get<std::string>()] =
+        previous.at("value").get<std::string>();
+  }
+}
+
+inline void from_json(const nlohmann::json &j, lsp::InlayHintParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+
+  int start_line, start_character, end_line, end_character;
+  j.at("range").at("start").at("line").get_to<int>(start_line);
+  j.at("range").at("start").at("character").get_to<int>(start_character);
+  j.at("range").at("end").at("line").get_to<int>(end_line);
+  j.at("range").at("end").at("character").get_to<int>(end_character);
+
+  params.range = lsp::Range{lsp::Position{start_line, start_character},
+                            lsp::Position{end_line, end_character}};
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::AssembledOutputParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+  if (j.contains("format") && j.at("format") == "hex")
+    params.format = lsp::AssembledOutputFormat::Hex;
+  if (j.contains("partialResultToken"))
+    params.partialResultToken = j.at("partialResultToken");
+}
+
+inline void from_json(const nlohmann::json &j, lsp::RunParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+  if (j.contains("maxCycles"))
+    j.at("maxCycles").get_to(params.maxCycles);
+  if (j.contains("watch"))
+    j.at("watch").get_to(params.watch);
+}
+
+inline void from_json(const nlohmann::json &j, lsp::FormattingOptions &o) {
+  j.at("tabSize").get_to(o.tabSize);
+  j.at("insertSpaces").get_to(o.insertSpaces);
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::DocumentFormattingParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+  params.options = j.at("options").get<lsp::FormattingOptions>();
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::DocumentRangeFormattingParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+
+  int start_line, start_character, end_line, end_character;
+  j.at("range").at("start").at("line").get_to<int>(start_line);
+  j.at("range").at("start").at("character").get_to<int>(start_character);
+  j.at("range").at("end").at("line").get_to<int>(end_line);
+  j.at("range").at("end").at("character").get_to<int>(end_character);
+
+  params.range = lsp::Range{lsp::Position{start_line, start_character},
+                            lsp::Position{end_line, end_character}};
+  params.options = j.at("options").get<lsp::FormattingOptions>();
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::SemanticTokensParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::SemanticTokensRangeParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+
+  int start_line, start_character, end_line, end_character;
+  j.at("range").at("start").at("line").get_to<int>(start_line);
+  j.at("range").at("start").at("character").get_to<int>(start_character);
+  j.at("range").at("end").at("line").get_to<int>(end_line);
+  j.at("range").at("end").at("character").get_to<int>(end_character);
+
+  params.range = lsp::Range{lsp::Position{start_line, start_character},
+                            lsp::Position{end_line, end_character}};
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::SemanticTokensDeltaParams &params) {
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+  j.at("previousResultId").get_to(params.previousResultId);
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::WorkspaceSymbolParams &params) {
+  j.at("query").get_to(params.query);
+}
+
+inline void from_json(const nlohmann::json &j,
+                      lsp::PrepareRenameParams &params) {
+  // textDocument
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+
+  // position
+  int line, character;
+  j.at("position").at("line").get_to<int>(line);
+  j.at("position").at("character").get_to<int>(character);
+  params.position = lsp::Position{line, character};
+}
+
+inline void from_json(const nlohmann::json &j, lsp::RenameParams &params) {
+  // textDocument
+  j.at("textDocument").at("uri").get_to(params.textDocument.uri);
+
+  // position
+  int line, character;
+  j.at("position").at("line").get_to<int>(line);
+  j.at("position").at("character").get_to<int>(character);
+  params.position = lsp::Position{line, character};
+
+  j.at("newName").get_to(params.newName);
+}
 } // namespace lsp
@@ -22,6 +22,33 @@ constexpr bool SAVE_INCLUDE_TEXT = false;
 // Features supported
 constexpr bool SUPPORTS_HOVER = true;
 constexpr bool SUPPORTS_COMPLETION = true;
+constexpr bool SUPPORTS_RENAME = true;
+constexpr bool SUPPORTS_WORKSPACE_SYMBOL = true;
+constexpr bool SUPPORTS_SEMANTIC_TOKENS = true;
+constexpr bool SUPPORTS_FORMATTING = true;
+constexpr bool SUPPORTS_INLAY_HINTS = true;
+
+// Server extensions, advertised under "experimental"
+constexpr bool SUPPORTS_ASSEMBLED_OUTPUT = true;
+constexpr bool SUPPORTS_RUN = true;
+
+// Pull diagnostics options
+constexpr const char *DIAGNOSTIC_IDENTIFIER = "hack-assembler";
+constexpr bool DIAGNOSTIC_INTER_FILE_DEPENDENCIES = false;
+constexpr bool DIAGNOSTIC_WORKSPACE_DIAGNOSTICS = true;
+
+// Workspace files watched through client/registerCapability
+constexpr const char *WATCHED_FILES_GLOB = "**/*.asm";
+
+// Semantic tokens legend, order matches SemanticTokensEngine
+constexpr const char *SEMANTIC_TOKEN_TYPES[] = {
+    "function", "variable", "number", "property",
+    "operator", "keyword",  "comment"};
+constexpr const char *SEMANTIC_TOKEN_MODIFIERS[] = {"declaration",
+                                                    "defaultLibrary"};
+
+// Rename options
+constexpr bool RENAME_PREPARE_PROVIDER = true;
 
 // Completion options
 constexpr bool COMPLETION_RESOLVE_PROVIDER = false;
@@ -46,7 +73,32 @@ inline nlohmann::ordered_json to_json() {
           {{"resolveProvider", COMPLETION_RESOLVE_PROVIDER},
            {"triggerCharacters",
             {COMPLETION_TRIGGER_CHARACTERS[0], COMPLETION_TRIGGER_CHARACTERS[1],
-             COMPLETION_TRIGGER_CHARACTERS[2]}}}}}},
+             COMPLETION_TRIGGER_CHARACTERS[2]}}}},
+
+         {"renameProvider", {{"prepareProvider", RENAME_PREPARE_PROVIDER}}},
+
+         {"workspaceSymbolProvider", SUPPORTS_WORKSPACE_SYMBOL},
+
+         {"semanticTokensProvider",
+          {{"legend",
+            {{"tokenTypes", SEMANTIC_TOKEN_TYPES},
+             {"tokenModifiers", SEMANTIC_TOKEN_MODIFIERS}}},
+           {"range", SUPPORTS_SEMANTIC_TOKENS},
+           {"full", {{"delta", SUPPORTS_SEMANTIC_TOKENS}}}}},
+
+         {"documentFormattingProvider", SUPPORTS_FORMATTING},
+         {"documentRangeFormattingProvider", SUPPORTS_FORMATTING},
+
+         {"inlayHintProvider", SUPPORTS_INLAY_HINTS},
+
+         {"diagnosticProvider",
+          {{"identifier", DIAGNOSTIC_IDENTIFIER},
+           {"interFileDependencies", DIAGNOSTIC_INTER_FILE_DEPENDENCIES},
+           {"workspaceDiagnostics", DIAGNOSTIC_WORKSPACE_DIAGNOSTICS}}},
+
+         {"experimental",
+          {{"assembledOutputProvider", SUPPORTS_ASSEMBLED_OUTPUT},
+           {"runProvider", SUPPORTS_RUN}}}}},
 
        {"serverInfo", {{"name", SERVER_NAME}, {"version", SERVER_VERSION}}}};
 
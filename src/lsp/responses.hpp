@@ -44,8 +44,37 @@ struct HoverItem {
 
 using HoverResult = std::variant<nullptr_t, HoverItem>;
 
-using Result = std::variant<std::nullptr_t, InitializeResult, CompletionResult,
-                            HoverResult>;
+enum class SymbolKind {
+  Function = 12,
+  Variable = 13,
+};
+
+struct SymbolInformation {
+  std::string name;
+  SymbolKind kind;
+  std::string uri;
+  Range range;
+};
+
+using WorkspaceSymbolResult = std::vector<SymbolInformation>;
+
+struct PrepareRenameItem {
+  Range range;
+  std::string placeholder;
+};
+
+using PrepareRenameResult = std::variant<nullptr_t, PrepareRenameItem>;
+
+// A result serialized ahead of time, spliced into the response body as-is so
+// large payloads never go through an intermediate json tree
+struct RawResult {
+  std::string json;
+};
+
+using Result =
+    std::variant<std::nullptr_t, InitializeResult, CompletionResult,
+                 HoverResult, PrepareRenameResult, WorkspaceSymbolResult,
+                 RawResult>;
 
 struct Response {
   int contentLength;
@@ -115,6 +144,45 @@ inline void to_json(nlohmann::basic_json<nlohmann::ordered_map> &j,
   }
 }
 
+inline void to_json(nlohmann::basic_json<nlohmann::ordered_map> &j,
+                    const PrepareRenameResult &result) {
+
+  if (std::holds_alternative<std::nullptr_t>(result)) {
+    j = nullptr;
+  } else {
+    const auto &res = std::get<PrepareRenameItem>(result);
+
+    j = {{"range",
+          {{"start",
+            {{"line", res.range.start.line},
+             {"character", res.range.start.character}}},
+           {"end",
+            {{"line", res.range.end.line},
+             {"character", res.range.end.character}}}}},
+         {"placeholder", res.placeholder}};
+  }
+}
+
+inline void to_json(nlohmann::basic_json<nlohmann::ordered_map> &j,
+                    const WorkspaceSymbolResult &result) {
+
+  j = nlohmann::ordered_json::array();
+  for (const auto &symbol : result) {
+    j.push_back(
+        {{"name", symbol.name},
+         {"kind", static_cast<int>(symbol.kind)},
+         {"location",
+          {{"uri", symbol.uri},
+           {"range",
+            {{"start",
+              {{"line", symbol.range.start.line},
+               {"character", symbol.range.start.character}}},
+             {"end",
+              {{"line", symbol.range.end.line},
+               {"character", symbol.range.end.character}}}}}}}});
+  }
+}
+
 inline void to_json(nlohmann::basic_json<nlohmann::ordered_map> &j,
                     const Result &result) {
 
@@ -124,8 +192,15 @@ inline void to_json(nlohmann::basic_json<nlohmann::ordered_map> &j,
     j = std::get<InitializeResult>(result);
   } else if (std::holds_alternative<CompletionResult>(result)) {
     to_json(j, std::get<CompletionResult>(result));
-  } else
+  } else if (std::holds_alternative<HoverResult>(result)) {
     to_json(j, std::get<HoverResult>(result));
+  } else if (std::holds_alternative<PrepareRenameResult>(result)) {
+    to_json(j, std::get<PrepareRenameResult>(result));
+  } else if (std::holds_alternative<WorkspaceSymbolResult>(result)) {
+    to_json(j, std::get<WorkspaceSymbolResult>(result));
+  } else {
+    j = nlohmann::ordered_json::parse(std::get<RawResult>(result).json);
+  }
 }
 
 inline void to_json(nlohmann::basic_json<nlohmann::ordered_map> &j,
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <nlohmann/json.hpp>
 #include <string>
 #include <variant>
 
@@ -42,8 +43,7 @@ using TextDocumentContentChangeEvent =
     std::variant<TextDocumentContentChangeEventWithRange,
                  TextDocumentContentChangeEventFull>;
 
-// TODO: fix this
-using LSPAny = int;
+using LSPAny = nlohmann::json;
 
 enum class TraceValue { Off, Messages, Verbose };
 
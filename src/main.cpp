@@ -1,26 +1,66 @@
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
 
+#include "core/BatchChecker.hpp"
 #include "core/LanguageServer.hpp"
+#include "core/SocketServer.hpp"
+#include "core/transport/MessageIO.hpp"
+#include "hack/SharedState.hpp"
 #include "lsp/protocol.hpp"
 
 struct ParseArgsResult {
   bool stdio;
   bool version;
+  bool check;
+  std::vector<std::string> checkPaths;
+  std::optional<std::string> socketPath;
+  std::optional<int> port;
 };
 
 ParseArgsResult parse_args(int argc, char **args) {
 
-  ParseArgsResult res = {false, false};
+  ParseArgsResult res = {false, false, false, {}, std::nullopt, std::nullopt};
   for (int i = 0; i < argc; i++) {
     if (strcmp(args[i], "--stdio") == 0)
       res.stdio = true;
     if (strcmp(args[i], "--version") == 0)
       res.version = true;
+
+    if (strcmp(args[i], "--socket") == 0 && i + 1 < argc)
+      res.socketPath = args[++i];
+
+    if (strcmp(args[i], "--port") == 0 && i + 1 < argc) {
+      char *end = nullptr;
+      long port = std::strtol(args[++i], &end, 10);
+      if (*end != '\0' || port <= 0 || port > 65535) {
+        std::cerr << "invalid port: " << args[i] << "\n" << std::flush;
+        std::exit(1);
+      }
+      res.port = static_cast<int>(port);
+    }
+
+    // Everything after --check is a path to lint
+    if (strcmp(args[i], "--check") == 0) {
+      res.check = true;
+      res.checkPaths.assign(args + i + 1, args + argc);
+      break;
+    }
+  }
+
+  if (res.check && res.checkPaths.empty()) {
+    std::cerr << "usage: hack-ls --check <paths...>\n" << std::flush;
+    std::exit(BatchChecker::FAILED);
   }
 
-  if (argc < 2 || (!res.stdio && !res.version)) {
-    std::cerr << "run with --stdio\n" << std::flush;
+  bool daemon = res.socketPath || res.port;
+  if (argc < 2 || (!res.stdio && !res.version && !res.check && !daemon)) {
+    std::cerr << "run with --stdio, --socket <path>, --port <port> or "
+                 "--check <paths...>\n"
+              << std::flush;
     std::exit(1);
   }
 
@@ -37,8 +77,25 @@ int main(int argc, char **args) {
               << std::endl;
     return 0;
 
+  } else if (res.check) {
+    BatchChecker checker(std::move(res.checkPaths));
+    return checker.run(std::cout);
+
+  } else if (res.socketPath || res.port) {
+    SharedState sharedState;
+    SocketServer server(sharedState);
+
+    if (res.socketPath && !server.listenUnix(*res.socketPath))
+      return 1;
+    if (res.port && !server.listenTcp(*res.port))
+      return 1;
+
+    return server.run();
+
   } else if (res.stdio) {
-    LanguageServer server;
+    SharedState sharedState;
+    MessageIO io;
+    LanguageServer server(io, sharedState);
     server.start();
   }
 
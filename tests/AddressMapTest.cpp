@@ -0,0 +1,200 @@
+// Differential test: an AddressMap kept up to date with update() must
+// answer like one built from scratch from the text after the change.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/structures/TextDocument.hpp"
+#include "hack/AddressMap.hpp"
+
+namespace {
+
+using Changes = std::vector<lsp::TextDocumentContentChangeEvent>;
+using Addresses = std::vector<std::pair<size_t, uint32_t>>;
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+  }
+}
+
+lsp::TextDocumentContentChangeEvent change(lsp::Position start,
+                                           lsp::Position end,
+                                           std::string text) {
+  lsp::TextDocumentContentChangeEventWithRange ranged;
+  ranged.range.start = start;
+  ranged.range.end = end;
+  ranged.text = std::move(text);
+  return ranged;
+}
+
+// The position of a byte offset, in UTF-16 code units like a client sends
+lsp::Position positionOf(const std::string &text, size_t offset) {
+  lsp::Position position{0, 0};
+  for (size_t i = 0; i < offset;) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c == '\n') {
+      position.line++;
+      position.character = 0;
+      i++;
+      continue;
+    }
+
+    size_t length = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    position.character += length == 4 ? 2 : 1;
+    i += length;
+  }
+  return position;
+}
+
+// Offsets that start a character, and the end of text
+std::vector<size_t> boundaries(const std::string &text) {
+  std::vector<size_t> found;
+  for (size_t i = 0; i <= text.size(); i++) {
+    if (i == text.size() ||
+        (static_cast<unsigned char>(text[i]) & 0xC0) != 0x80)
+      found.push_back(i);
+  }
+  return found;
+}
+
+size_t lineCount(const std::string &text) {
+  return static_cast<size_t>(std::count(text.begin(), text.end(), '\n')) + 1;
+}
+
+Addresses addresses(AddressMap &map, size_t first, size_t last) {
+  Addresses found;
+  map.forEachAddress(first, last, [&](size_t line, uint32_t address) {
+    found.push_back({line, address});
+  });
+  return found;
+}
+
+// Compares map with a map built from text
+void checkSame(const std::string &name, AddressMap &map,
+               const std::string &text, std::mt19937 &random) {
+  AddressMap fresh;
+  fresh.build(text);
+
+  size_t lines = lineCount(text);
+  for (size_t line = 0; line < lines + 2; line++) {
+    if (map.address(line) != fresh.address(line)) {
+      check(false, name + ": address of line " + std::to_string(line));
+      return;
+    }
+  }
+
+  check(addresses(map, 0, lines) == addresses(fresh, 0, lines),
+        name + ": all addresses differ");
+  size_t first = random() % lines;
+  size_t last = first + random() % (lines - first);
+  check(addresses(map, first, last) == addresses(fresh, first, last),
+        name + ": addresses of lines " + std::to_string(first) + "-" +
+            std::to_string(last) + " differ");
+}
+
+// Edits of a few pieces each, over instructions, labels, comments, blank
+// lines, multi-byte characters and CRLF. Batches are either in the
+// descending order editors send or each change is placed in the text the
+// previous one left, in any order.
+void checkRandom() {
+  const std::vector<std::string> pieces = {
+      "@i",   "D=M\n", "(LOOP)", "// c", "\n",   "0;JMP",
+      "\r\n", "  ",    "é",      "😀",   "\n\n", "AM=M+1\n"};
+  std::mt19937 random(2024);
+  auto pick = [&](size_t count) { return random() % count; };
+  auto piecesOf = [&](size_t count) {
+    std::string text;
+    for (size_t i = 0; i < count; i++) {
+      text += pieces[pick(pieces.size())];
+    }
+    return text;
+  };
+
+  for (int round = 0; round < 200; round++) {
+    // Some texts span several chunks, so edits split and drop chunks
+    TextDocument document("file:///test.asm", 1,
+                          piecesOf(pick(4) == 0 ? 4000 : pick(200)));
+    AddressMap map;
+    map.build(document.text);
+
+    for (int step = 0; step < 30; step++) {
+      std::string name =
+          "round " + std::to_string(round) + " step " + std::to_string(step);
+
+      Changes changes;
+      size_t count = 1 + pick(4);
+      if (pick(2) == 0) {
+        auto offsets = boundaries(document.text);
+        std::vector<size_t> picked;
+        for (size_t i = 0; i < 2 * count; i++) {
+          picked.push_back(offsets[pick(offsets.size())]);
+        }
+        std::sort(picked.rbegin(), picked.rend());
+
+        for (size_t i = 0; i < count; i++) {
+          const std::string &text = document.text;
+          changes.push_back(change(positionOf(text, picked[2 * i + 1]),
+                                   positionOf(text, picked[2 * i]),
+                                   piecesOf(pick(4))));
+        }
+      } else {
+        TextDocument scratch("file:///scratch.asm", 1, document.text);
+        for (size_t i = 0; i < count; i++) {
+          auto offsets = boundaries(scratch.text);
+          size_t start = offsets[pick(offsets.size())];
+          size_t end = std::min(offsets.back(), start + pick(3) * pick(20));
+          end = *std::lower_bound(offsets.begin(), offsets.end(), end);
+
+          changes.push_back(change(positionOf(scratch.text, start),
+                                   positionOf(scratch.text, end),
+                                   piecesOf(pick(4))));
+          scratch.applyChanges({changes.back()});
+        }
+      }
+
+      auto splices = document.applyChanges(changes);
+      map.update(document.text, splices);
+      checkSame(name, map, document.text, random);
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 random(7);
+
+  AddressMap map;
+  std::string text = "@i\nM=1\n(LOOP)\n@LOOP\n0;JMP\n";
+  TextDocument document("file:///test.asm", 1, text);
+  map.build(document.text);
+
+  // A label turned into an instruction moves every address after it
+  map.update(document.text,
+             document.applyChanges({change({2, 0}, {2, 6}, "D=A")}));
+  checkSame("label to instruction", map, document.text, random);
+
+  // Lines joined and split in one batch, on CRLF text
+  TextDocument crlf("file:///crlf.asm", 1, "@i\r\nM=1\r\n(END)\r\n@END\r\n");
+  map.build(crlf.text);
+  map.update(crlf.text,
+             crlf.applyChanges({change({3, 4}, {3, 4}, "\r\nD;JGT"),
+                                change({0, 2}, {1, 0}, " ")}));
+  checkSame("CRLF join and split", map, crlf.text, random);
+
+  checkRandom();
+
+  if (failures != 0)
+    return 1;
+  std::puts("Updated address maps match rebuilt ones");
+  return 0;
+}
@@ -0,0 +1,175 @@
+// Differential test: ChunkedAssembler must give the symbols and diagnostics
+// a single assemble() of the whole text gives, or nullopt.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hack/ChunkedAssembler.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+  }
+}
+
+std::string readFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return buffer.str();
+}
+
+AssemblyResult assembleSerial(std::string source) {
+  AssemblerConfig config = {0, 0};
+  AssemblerResult result = assemble(source.data(), config);
+  auto assembly = AssemblyResult::fromAssembler(result, 0);
+  AssemblerResult__free(&result, config);
+  return assembly;
+}
+
+// Symbols by name and diagnostics by line; the order diagnostics are
+// reported in is the assembler's business
+struct Summary {
+  std::map<std::string, int> symbols;
+  std::vector<std::pair<int, std::string>> diagnostics;
+
+  explicit Summary(const AssemblyResult &result) {
+    for (size_t i = 0; i < result.symbolCount(); i++) {
+      auto symbol = result.symbol(i);
+      symbols.emplace(symbol.name, symbol.value);
+    }
+    for (size_t i = 0; i < result.diagnosticCount(); i++) {
+      auto problem = result.diagnostic(i);
+      diagnostics.push_back({problem.line, std::string(problem.message)});
+    }
+    std::sort(diagnostics.begin(), diagnostics.end());
+  }
+
+  bool operator==(const Summary &) const = default;
+};
+
+// Compares a chunked assembly of source with a serial one
+void checkSame(const std::string &name, const std::string &source,
+               size_t chunkBytes, unsigned threads = 4) {
+  auto chunked =
+      ChunkedAssembler::assemble(source, 0, threads, nullptr, chunkBytes);
+  check(chunked.has_value(), name + ": not chunked");
+  if (!chunked)
+    return;
+
+  Summary expected(assembleSerial(source));
+  Summary actual(*chunked);
+  check(actual.symbols == expected.symbols, name + ": symbols differ");
+  check(actual.diagnostics == expected.diagnostics,
+        name + ": diagnostics differ");
+
+  for (const auto &[symbol, value] : expected.symbols) {
+    check(chunked->value(symbol) == value, name + ": lookup of " + symbol);
+  }
+}
+
+// Copy of source with every label it declares renamed for copy n, so
+// copies can be concatenated without duplicate labels
+std::string renameLabels(const std::string &source, int n) {
+  std::vector<std::string> labels;
+  hack::forEachLine(source, [&](int, std::string_view line) {
+    std::string_view name = hack::labelDeclaration(line);
+    if (!name.empty())
+      labels.emplace_back(name);
+    return true;
+  });
+  std::sort(labels.begin(), labels.end());
+
+  std::string renamed;
+  size_t i = 0;
+  while (i < source.size()) {
+    if (!hack::isSymbolStart(source[i]) ||
+        (i > 0 && hack::isSymbolChar(source[i - 1]))) {
+      renamed += source[i++];
+      continue;
+    }
+
+    size_t end = i;
+    while (end < source.size() && hack::isSymbolChar(source[end]))
+      end++;
+    std::string word = source.substr(i, end - i);
+    renamed += word;
+    if (std::binary_search(labels.begin(), labels.end(), word))
+      renamed += "_" + std::to_string(n);
+    i = end;
+  }
+  return renamed;
+}
+
+std::string filler(int lines) {
+  std::string text;
+  for (int i = 0; i < lines; i++) {
+    text += i % 3 == 0 ? "@" + std::to_string(i) + "\n"
+                       : "D=D+A // filler\n";
+  }
+  return text;
+}
+
+} // namespace
+
+int main() {
+  std::string pong = readFile(TESTS_DIR "/Pong.asm");
+  check(!pong.empty(), "Pong.asm not found");
+
+  for (size_t chunks : {2, 3, 7, 16}) {
+    checkSame("Pong in " + std::to_string(chunks) + " chunks", pong,
+              pong.size() / chunks);
+  }
+  checkSame("Pong on one thread", pong, pong.size() / 5, 1);
+
+  std::string large;
+  for (int n = 0; n < 12; n++) {
+    large += renameLabels(pong, n);
+  }
+  checkSame("concatenated Pong", large, ChunkedAssembler::CHUNK_BYTES);
+
+  // Labels used before the chunk declaring them, in either direction
+  std::string crossChunk = "@END\n0;JMP\n" + filler(2000) + "(MIDDLE)\n" +
+                           "@END\n" + filler(2000) + "@MIDDLE\n(END)\n" +
+                           "@END\n0;JMP";
+  checkSame("cross-chunk labels", crossChunk, crossChunk.size() / 3);
+
+  // Variables until a later chunk declares them as labels
+  std::string shadowed = "@first\nM=1\n@late\nM=D\n@second\n" + filler(3000) +
+                         "(late)\n@third\nM=0\n@first\n" + filler(3000) +
+                         "@fourth\n(second)\n";
+  checkSame("variables shadowed by labels", shadowed, shadowed.size() / 3);
+
+  std::string errors = "@ok\n(bad\nD=Q\n(DUP)\n(DUP)\n" + filler(2000) +
+                       "AM=;JMP\n(\n@ok\n()\n" + filler(2000) + "X=D\n";
+  checkSame("error inputs", errors, errors.size() / 3);
+
+  // Neither chunk would report the duplicate, so the text is not chunked
+  std::string duplicate = "(TWICE)\n" + filler(2000) + "(TWICE)\n";
+  check(!ChunkedAssembler::assemble(duplicate, 0, 4, nullptr,
+                                    duplicate.size() / 2),
+        "duplicate label across chunks was chunked");
+
+  check(!ChunkedAssembler::assemble(pong, 0, 4), "short text was chunked");
+
+  std::atomic<bool> cancelled = true;
+  check(!ChunkedAssembler::assemble(large, 0, 4, &cancelled),
+        "cancelled assembly returned a result");
+
+  if (failures != 0)
+    return 1;
+  std::puts("ChunkedAssembler matches assemble()");
+  return 0;
+}
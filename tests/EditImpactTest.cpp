@@ -0,0 +1,200 @@
+// Differential test: when EditImpact finds that a change touched no code,
+// the result HackAssembler::shift derives from the previous one must have
+// the symbols and diagnostics a fresh assembly of the new text has.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/handlers/DocumentsHandler.hpp"
+#include "hack/EditImpact.hpp"
+#include "hack/HackAssembler.hpp"
+#include "hack/ResultPool.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+  }
+}
+
+std::string readFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return buffer.str();
+}
+
+// Symbols by name and diagnostics by line, as in ChunkedAssemblerTest
+struct Summary {
+  std::map<std::string, int> symbols;
+  std::vector<std::pair<int, std::string>> diagnostics;
+
+  explicit Summary(const AssemblyResult &result) {
+    for (size_t i = 0; i < result.symbolCount(); i++) {
+      auto symbol = result.symbol(i);
+      symbols.emplace(symbol.name, symbol.value);
+    }
+    for (size_t i = 0; i < result.diagnosticCount(); i++) {
+      auto problem = result.diagnostic(i);
+      diagnostics.push_back({problem.line, std::string(problem.message)});
+    }
+    std::sort(diagnostics.begin(), diagnostics.end());
+  }
+
+  bool operator==(const Summary &) const = default;
+};
+
+lsp::TextDocumentContentChangeEvent change(int line, int startCharacter,
+                                           int endCharacter, std::string text) {
+  lsp::TextDocumentContentChangeEventWithRange ranged;
+  ranged.range.start = {line, startCharacter};
+  ranged.range.end = {line, endCharacter};
+  ranged.text = std::move(text);
+  return ranged;
+}
+
+std::vector<std::string_view> linesOf(std::string_view text) {
+  std::vector<std::string_view> lines;
+  hack::forEachLine(text, [&](int, std::string_view line) {
+    lines.push_back(line);
+  });
+  return lines;
+}
+
+// An edit to one line that mostly leaves its code alone: spaces, comments
+// and blank lines, and now and then a "//" that comments code out
+lsp::TextDocumentContentChangeEvent randomEdit(std::string_view text,
+                                               std::mt19937 &random) {
+  auto lines = linesOf(text);
+  int line = static_cast<int>(random() % lines.size());
+  std::string_view lineText = lines[line];
+  int length = static_cast<int>(lineText.size()); // ASCII texts only
+  int column = length == 0 ? 0 : static_cast<int>(random() % (length + 1));
+  int comment = static_cast<int>(hack::stripComment(lineText).size());
+
+  switch (random() % 8) {
+  case 0:
+    return change(line, column, column, " ");
+  case 1:
+    return change(line, column, column, "\t");
+  case 2:
+    return change(line, length, length, " // note");
+  case 3:
+    return change(line, 0, 0, "\n");
+  case 4:
+    return change(line, length, length, "\n// added\n");
+  case 5:
+    return change(line, comment, length, "");
+  case 6:
+    return change(line, comment, length, comment < length ? "// new" : "");
+  default:
+    return change(line, column, column, "//");
+  }
+}
+
+// Applies changes to uri and, if they touched no code, shifts its result
+// and compares it with a fresh assembly. Returns whether it shifted.
+bool checkEdit(const std::string &name, DocumentsHandler &documents,
+               HackAssembler &assembler, const std::string &uri, int version,
+               std::vector<lsp::TextDocumentContentChangeEvent> changes) {
+  auto previous = documents.snapshot(uri);
+  auto splices = documents.onChange({{{uri}, version}, std::move(changes)});
+  auto current = documents.snapshot(uri);
+
+  auto impact = EditImpact::classify(previous->text, current->text, splices);
+  bool shifted =
+      !impact.touchesCode() &&
+      assembler.shift(uri, hash::hash64(previous->text), impact);
+
+  if (!shifted) {
+    // A declined shift must be down to a diagnostic on a rewritten line
+    if (!impact.touchesCode()) {
+      auto result = assembler.getResult(uri);
+      bool rewritten = false;
+      for (size_t i = 0; i < result->diagnosticCount(); i++) {
+        rewritten |= !impact.moveLine(result->diagnostic(i).line - 1);
+      }
+      check(rewritten, name + ": shift declined for no reason");
+    }
+    assembler.run(uri);
+    return false;
+  }
+
+  Summary expected(HackAssembler::assembleText(
+      current->text, hash::hash64(current->text), false));
+  Summary actual(*assembler.getResult(uri));
+  check(actual.symbols == expected.symbols, name + ": symbols differ");
+  check(actual.diagnostics == expected.diagnostics,
+        name + ": diagnostic lines differ");
+  return true;
+}
+
+void checkRandom(const std::string &name, const std::string &text,
+                 int seed) {
+  DocumentsHandler documents;
+  ResultPool pool;
+  HackAssembler assembler(documents, pool);
+
+  std::string uri = "file:///" + name + ".asm";
+  documents.onOpen({{{uri}, "hack", 1, text}});
+  assembler.run(uri);
+
+  std::mt19937 random(seed);
+  int shifts = 0;
+  for (int version = 2; version < 400; version++) {
+    std::vector<lsp::TextDocumentContentChangeEvent> changes;
+    changes.push_back(randomEdit(documents.snapshot(uri)->text, random));
+    shifts += checkEdit(name + " version " + std::to_string(version),
+                        documents, assembler, uri, version,
+                        std::move(changes));
+  }
+  check(shifts > 0, name + ": no edit was shifted");
+}
+
+} // namespace
+
+int main() {
+  std::string pong = readFile(TESTS_DIR "/Pong.asm");
+  check(!pong.empty(), "Pong.asm not found");
+  checkRandom("Pong", pong, 1);
+
+  // Diagnostics next to comments and blank lines
+  std::string errors = "// errors\n@ok\n\nD=Q // bad comp\n(DUP)\n\n(DUP)\n"
+                       "// between\nAM=;JMP\n@ok\n0;JMP\n";
+  checkRandom("errors", errors, 2);
+
+  // Rewriting the comment on a line with a diagnostic leaves it there, but
+  // a rewritten line without code has nowhere to move one to
+  std::string before = "@i\n// one\nD=Q // two\n\nM=D\n";
+  std::string after = "@i\n// ONE\nD=Q // TWO\n// c\nM=D\n";
+  TextDocument document("file:///moves.asm", 1, before);
+  auto splices = document.applyChanges(
+      {change(3, 0, 0, "// c"), change(2, 7, 10, "TWO"),
+       change(1, 3, 6, "ONE")});
+  check(document.text == after, "moves: unexpected text");
+
+  auto impact = EditImpact::classify(before, after, splices);
+  check(!impact.touchesCode(), "moves: code touched");
+  check(impact.moveLine(0) == 0, "moves: line before the change moved");
+  check(!impact.moveLine(1), "moves: rewritten comment line kept");
+  check(impact.moveLine(2) == 2, "moves: code line with a comment lost");
+  check(!impact.moveLine(3), "moves: rewritten blank line kept");
+  check(impact.moveLine(4) == 4, "moves: line after the change");
+
+  if (failures != 0)
+    return 1;
+  std::puts("Shifted results match fresh assemblies");
+  return 0;
+}
@@ -0,0 +1,171 @@
+// Differential test: a didChange batch applied in one sweep must leave the
+// text and line splices that applying its changes one at a time leaves.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/structures/TextDocument.hpp"
+
+namespace {
+
+using Changes = std::vector<lsp::TextDocumentContentChangeEvent>;
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    failures++;
+  }
+}
+
+bool sameSplices(const std::vector<LineSplice> &lhs,
+                 const std::vector<LineSplice> &rhs) {
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                    [](const LineSplice &a, const LineSplice &b) {
+                      return a.startLine == b.startLine &&
+                             a.removedLines == b.removedLines &&
+                             a.addedLines == b.addedLines;
+                    });
+}
+
+// Applies changes together, as a didChange does, and one per call, which
+// never takes the batch path, and compares the outcomes
+void checkSame(const std::string &name, const std::string &text,
+               const Changes &changes) {
+  TextDocument batched("file:///test.asm", 1, text);
+  auto batchedSplices = batched.applyChanges(changes);
+
+  TextDocument single("file:///test.asm", 1, text);
+  std::vector<LineSplice> singleSplices;
+  for (const auto &change : changes) {
+    for (const auto &splice : single.applyChanges({change})) {
+      singleSplices.push_back(splice);
+    }
+  }
+
+  check(batched.text == single.text, name + ": text differs");
+  check(sameSplices(batchedSplices, singleSplices),
+        name + ": splices differ");
+}
+
+lsp::TextDocumentContentChangeEvent change(int startLine, int startCharacter,
+                                           int endLine, int endCharacter,
+                                           std::string text) {
+  lsp::TextDocumentContentChangeEventWithRange ranged;
+  ranged.range.start = {startLine, startCharacter};
+  ranged.range.end = {endLine, endCharacter};
+  ranged.text = std::move(text);
+  return ranged;
+}
+
+// The position of a byte offset, in UTF-16 code units like a client sends
+lsp::Position positionOf(const std::string &text, size_t offset) {
+  lsp::Position position{0, 0};
+  for (size_t i = 0; i < offset;) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c == '\n') {
+      position.line++;
+      position.character = 0;
+      i++;
+      continue;
+    }
+
+    size_t length = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    position.character += length == 4 ? 2 : 1;
+    i += length;
+  }
+  return position;
+}
+
+// Random texts and batches over ASCII, multi-byte characters, surrogate
+// pairs and CRLF. Most batches are in the descending order editors send;
+// the rest are shuffled, may overlap or point inside a character.
+void checkRandom() {
+  const std::vector<std::string> pieces = {"@i", "D=M\n", "é",  "😀",
+                                           "\n", "0;JMP",  "", "\r\n"};
+  std::mt19937 random(2024);
+  auto pick = [&](size_t count) { return random() % count; };
+
+  for (int round = 0; round < 3000; round++) {
+    std::string text;
+    for (size_t i = 0, n = pick(60); i < n; i++) {
+      text += pieces[pick(pieces.size())];
+    }
+
+    std::vector<size_t> boundaries;
+    for (size_t i = 0; i <= text.size(); i++) {
+      if (i == text.size() ||
+          (static_cast<unsigned char>(text[i]) & 0xC0) != 0x80)
+        boundaries.push_back(i);
+    }
+
+    size_t count = 2 + pick(4);
+    std::vector<size_t> offsets;
+    for (size_t i = 0; i < 2 * count; i++) {
+      offsets.push_back(boundaries[pick(boundaries.size())]);
+    }
+    std::sort(offsets.rbegin(), offsets.rend());
+
+    Changes changes;
+    for (size_t i = 0; i < count; i++) {
+      lsp::Position start = positionOf(text, offsets[2 * i + 1]);
+      lsp::Position end = positionOf(text, offsets[2 * i]);
+      if (pick(3) == 0)
+        end.character += static_cast<int>(pick(3));
+      changes.push_back(change(start.line, start.character, end.line,
+                               end.character, pieces[pick(pieces.size())]));
+    }
+    if (pick(4) == 0)
+      std::shuffle(changes.begin(), changes.end(), random);
+
+    checkSame("random batch " + std::to_string(round), text, changes);
+  }
+}
+
+} // namespace
+
+int main() {
+  std::string ascii = "@i\nM=1\n(LOOP)\n@LOOP\n0;JMP\n";
+  checkSame("multi-cursor insert", ascii,
+            {change(3, 0, 3, 0, "  "), change(1, 0, 1, 0, "  ")});
+  checkSame("replace all", ascii,
+            {change(3, 1, 3, 5, "END"), change(2, 1, 2, 5, "END")});
+  checkSame("line joins", ascii,
+            {change(3, 5, 4, 0, " "), change(0, 2, 1, 0, " ")});
+
+  // Inserts at one offset: each goes before the text of the one before it
+  checkSame("equal-offset inserts", ascii,
+            {change(1, 0, 1, 0, "a"), change(1, 0, 1, 0, "b"),
+             change(1, 0, 1, 0, "c\n")});
+
+  std::string unicode = "// é😀\n@é\n// 😀😀\nD=M\n";
+  checkSame("multi-byte", unicode,
+            {change(2, 5, 2, 5, "x"), change(0, 3, 0, 4, "")});
+  checkSame("surrogate pair", unicode,
+            {change(2, 4, 2, 5, "y"), change(0, 4, 0, 6, "é")});
+  checkSame("inside surrogate pair", unicode,
+            {change(2, 4, 2, 4, "y"), change(0, 5, 0, 5, "z")});
+
+  std::string crlf = "@i\r\nM=1\r\n(LOOP)\r\n@LOOP\r\n";
+  checkSame("CRLF", crlf,
+            {change(3, 0, 3, 0, "\t"), change(1, 3, 2, 0, "\r\n")});
+
+  // Not in descending order, so applied one by one
+  checkSame("ascending", ascii,
+            {change(1, 0, 1, 0, "x"), change(3, 0, 3, 0, "y")});
+  checkSame("overlapping", ascii,
+            {change(3, 0, 3, 4, "x"), change(2, 0, 3, 2, "y")});
+  checkSame("past line end", ascii,
+            {change(3, 9, 3, 9, "x"), change(1, 0, 1, 0, "y")});
+
+  checkRandom();
+
+  if (failures != 0)
+    return 1;
+  std::puts("Batched changes match sequential ones");
+  return 0;
+}